@@ -1931,6 +1931,7 @@ static const struct {
   { "show-all-if-unmodified",	&_rl_complete_show_unmodified,	0 },
   { "show-mode-in-prompt",	&_rl_show_mode_in_prompt,	0 },
   { "skip-completed-text",	&_rl_skip_completed_text,	0 },
+  { "synchronized-output",	&_rl_synchronized_output,	0 },
 #if defined (VISIBLE_STATS)
   { "visible-stats",		&rl_visible_stats,		0 },
 #endif /* VISIBLE_STATS */
@@ -2006,6 +2007,7 @@ static int sv_histsize (const char *);
 static int sv_isrchterm (const char *);
 static int sv_keymap (const char *);
 static int sv_seqtimeout (const char *);
+static int sv_redisplay_delay (const char *);
 static int sv_viins_modestr (const char *);
 static int sv_vicmd_modestr (const char *);
 
@@ -2027,6 +2029,7 @@ static const struct {
   { "isearch-terminators", V_STRING,	sv_isrchterm },
   { "keymap",		V_STRING,	sv_keymap },
   { "keyseq-timeout",	V_INT,		sv_seqtimeout },
+  { "redisplay-max-delay", V_INT,	sv_redisplay_delay },
   { "vi-cmd-mode-string", V_STRING,	sv_vicmd_modestr }, 
   { "vi-ins-mode-string", V_STRING,	sv_viins_modestr }, 
   { (char *)NULL,	0, (_rl_sv_func_t *)0 }
@@ -2234,6 +2237,22 @@ sv_seqtimeout (const char *value)
   return 0;
 }
 
+static int
+sv_redisplay_delay (const char *value)
+{
+  int nval;
+
+  nval = 0;
+  if (value && *value)
+    {
+      nval = atoi (value);
+      if (nval < 0)
+	nval = 0;
+    }
+  _rl_redisplay_max_delay = nval;
+  return 0;
+}
+
 static int
 sv_region_start_color (const char *value)
 {
@@ -3027,6 +3046,11 @@ _rl_get_string_variable_value (const char *name)
       sprintf (numbuf, "%d", _rl_keyseq_timeout);    
       return (numbuf);
     }
+  else if (_rl_stricmp (name, "redisplay-max-delay") == 0)
+    {
+      sprintf (numbuf, "%d", _rl_redisplay_max_delay);
+      return (numbuf);
+    }
   else if (_rl_stricmp (name, "emacs-mode-string") == 0)
     return (_rl_emacs_mode_str ? _rl_emacs_mode_str : RL_EMACS_MODESTR_DEFAULT);
   else if (_rl_stricmp (name, "vi-cmd-mode-string") == 0)
@@ -1691,6 +1691,7 @@ display_matches (char **matches)
   char *temp;
 
   /* Move to the last visible line of a possibly-multiple-line command. */
+  _rl_flush_redisplay ();
   _rl_move_vert (_rl_vis_botlin);
 
   /* Handle simple case first.  What if there is only one answer? */
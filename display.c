@@ -83,6 +83,18 @@ static char *expand_prompt (char *, int, int *, int *, int *, int *);
 
 #define DEFAULT_LINE_BUFFER_SIZE	1024
 
+/* Where rl_redisplay was in the line buffer when it started drawing screen
+   line N: IN is the index into rl_line_buffer, OUT the index into the
+   display line, LPOS the screen column.  WRAPPED is the multicolumn
+   character padding pending at that point and WBREAK the padding noted for
+   the line itself.  IN is -1 if no character started the line (the prompt,
+   or a line filled by the tail of a tab). */
+struct line_checkpoint
+  {
+    int in, out, lpos;
+    int wrapped, wbreak;
+  };
+
 /* State of visible and invisible lines. */
 struct line_state
   {
@@ -94,6 +106,9 @@ struct line_state
     int wbsize;
     int *wrapped_line;
 #endif
+    struct line_checkpoint *checkpoints;
+    int cpsize;
+    int cpcount;
   };
 
 /* The line display buffers.  One is the line currently displayed on
@@ -136,6 +151,7 @@ static int _rl_col_width (const char *, int, int, int);
 
 #define FACE_NORMAL	'0'
 #define FACE_STANDOUT	'1'
+#define FACE_SUGGESTION	'2'
 #define FACE_INVALID	((char)1)
   
 /* **************************************************************** */
@@ -192,6 +208,14 @@ int _rl_vi_cmd_modestr_len;
 int _rl_suppress_redisplay = 0;
 int _rl_want_redisplay = 0;
 
+/* Text drawn dimmed after the end of the line while the cursor is there,
+   as a hint of how the line could be completed.  It is not part of the
+   line buffer; the application sets it before redisplay (see
+   ncsh_readline.c).  Non-zero SUGGESTION_DISPLAYED means some of it is on
+   the screen now. */
+char *_rl_suggestion = (char *)NULL;
+static int suggestion_displayed = 0;
+
 /* The visible cursor position.  If you print some text, adjust this. */
 /* NOTE: _rl_last_c_pos is used as a buffer index when not in a locale
    supporting multibyte characters, and an absolute cursor position when
@@ -241,6 +265,40 @@ static int line_size  = 0;
    automatically because the terminal was resized to height 1. */
 static int horizontal_scrolling_autoset = 0;	/* explicit initialization */
 
+/* Incremental redisplay.  rl_insert_text and rl_delete_text report the
+   lowest buffer index they change in REDISPLAY_DAMAGE (-1 if nothing has
+   changed since the last redisplay), and DRAWN_LINE keeps a copy of the
+   buffer as it was last drawn so changes made behind their back are
+   caught.  If the prompt and the screen geometry are the same as last
+   time, rl_redisplay picks up from the last checkpoint before the first
+   change and the cursor, copies everything before it from the visible
+   line, and compares only the screen lines from there on.  Editing near
+   the end of a long pasted command then costs the lines it touches.  If
+   the buffer is exactly the one drawn (only the cursor moved), drawing
+   stops at the first checkpoint past the cursor that matches the visible
+   one, and the rest of the line is copied as well. */
+static int redisplay_damage = -1;
+
+/* The same low-water mark, left for callers that follow the line buffer
+   between redisplays (ncsh_readline's suggestion cursor).  Whoever reads
+   it sets it back to -1. */
+int _rl_line_damage = -1;
+
+static char *drawn_line;
+static int drawn_len, drawn_size;
+
+static struct
+  {
+    int valid;		/* the visible line can be resumed from */
+    int screenwidth;
+    int prompt_out;	/* length of the prompt part of the display line */
+    int prompt_lpos, prompt_lines;
+    int wrap_offset;
+    int mb_cur_max, byte_oriented, meta;
+    int text_out, text_lpos;	/* where the buffer contents ended */
+    int text_lines, text_wrapped;
+  } drawn_layout;
+
 /* Variables to keep track of the expanded prompt string, which may
    include invisible characters. */
 
@@ -281,6 +339,35 @@ static int prompt_physical_chars;
    rl_redisplay instead of having rl_redisplay try to guess about invisible
    characters in the prompt or use heuristics about where they are. */
 static int *local_prompt_newlines;
+static int local_prompt_newlines_size;
+
+/* rl_expand_prompt remembers its results for the last prompt it expanded,
+   keyed by the prompt text and everything else expand_prompt looks at,
+   since callers such as ncsh_readline set the same prompt on every line.
+   An unchanged prompt gets the cached strings back instead of being
+   scanned for invisible characters and measured again, so local_prompt
+   and local_prompt_prefix may be the cache's: free them with
+   free_local_prompt. */
+static struct
+  {
+    int valid;
+    char *prompt;		/* the prompt as passed to rl_expand_prompt */
+    size_t len;
+    unsigned long hash;
+    int is_rl_prompt;		/* prompt == rl_prompt, for the mode string */
+    char *modestr;		/* mode string, if show-mode-in-prompt is on */
+    int modestr_len;
+    int screenwidth;
+    int mb_cur_max, byte_oriented, utf8locale;
+
+    char *local_prompt, *local_prompt_prefix;
+    int *newlines;		/* local_prompt_newlines, including the -1 */
+    int nnewlines;
+    int local_prompt_len;
+    int visible_length, prefix_length, last_invisible;
+    int invis_chars_first_line, physical_chars;
+    int retval;
+  } prompt_cache;
 
 /* set to a non-zero value by rl_redisplay if we are marking modified history
    lines and the current line is so marked. */
@@ -295,6 +382,7 @@ static int line_totbytes;
 static char *saved_local_prompt;
 static char *saved_local_prefix;
 static int *saved_local_prompt_newlines;
+static int saved_local_prompt_newlines_size;
 
 static int saved_last_invisible;
 static int saved_visible_length;
@@ -399,6 +487,7 @@ expand_prompt (char *pmt, int flags, int *lp, int *lip, int *niflp, int *vlp)
 	    *vlp = l;
 
 	  local_prompt_newlines = (int *) xrealloc (local_prompt_newlines, sizeof (int) * 2);
+	  local_prompt_newlines_size = 2;
 	  local_prompt_newlines[0] = 0;
 	  local_prompt_newlines[1] = -1;
 
@@ -413,6 +502,7 @@ expand_prompt (char *pmt, int flags, int *lp, int *lip, int *niflp, int *vlp)
      keeps track of where the line wraps happen */
   newlines_guess = (_rl_screenwidth > 0) ? APPROX_DIV(l,  _rl_screenwidth) : APPROX_DIV(l, 80);
   local_prompt_newlines = (int *) xrealloc (local_prompt_newlines, sizeof (int) * (newlines_guess + 1));
+  local_prompt_newlines_size = newlines_guess + 1;
   local_prompt_newlines[newlines = 0] = 0;
   for (rl = 1; rl <= newlines_guess; rl++)
     local_prompt_newlines[rl] = -1;
@@ -558,6 +648,150 @@ _rl_reset_prompt (void)
   rl_visible_prompt_length = rl_expand_prompt (rl_prompt);
 }
 
+/* Return a hash of the LEN bytes of prompt string S. */
+static unsigned long
+prompt_hash (const char *s, size_t len)
+{
+  unsigned long h;
+  size_t i;
+
+  /* FNV-1a */
+  for (h = 2166136261UL, i = 0; i < len; i++)
+    h = (h ^ (unsigned char)s[i]) * 16777619UL;
+  return h;
+}
+
+/* Return non-zero if the cached expansion of PROMPT, LEN bytes long with
+   hash HASH, is still valid for the current mode string, screen width
+   and locale. */
+static int
+prompt_cache_valid (char *prompt, size_t len, unsigned long hash)
+{
+  char *ms;
+  int mlen;
+
+  if (prompt_cache.valid == 0 ||
+	prompt_cache.hash != hash ||
+	prompt_cache.len != len ||
+	prompt_cache.is_rl_prompt != (prompt == rl_prompt) ||
+	prompt_cache.screenwidth != _rl_screenwidth ||
+	prompt_cache.mb_cur_max != MB_CUR_MAX ||
+	prompt_cache.byte_oriented != rl_byte_oriented ||
+	prompt_cache.utf8locale != _rl_utf8locale ||
+	memcmp (prompt_cache.prompt, prompt, len) != 0)
+    return 0;
+
+  ms = _rl_show_mode_in_prompt ? prompt_modestr (&mlen) : 0;
+  if (ms == 0)
+    return (prompt_cache.modestr == 0);
+  return (prompt_cache.modestr && prompt_cache.modestr_len == mlen &&
+	  memcmp (prompt_cache.modestr, ms, mlen) == 0);
+}
+
+/* Remember the results of expanding PROMPT, LEN bytes long with hash HASH,
+   which rl_expand_prompt returned as RETVAL.  The cache takes over
+   local_prompt and local_prompt_prefix. */
+static void
+prompt_cache_save (char *prompt, size_t len, unsigned long hash, int retval)
+{
+  char *ms;
+  int mlen, n;
+
+  FREE (prompt_cache.prompt);
+  FREE (prompt_cache.modestr);
+  /* A prompt saved by rl_save_prompt keeps the strings it was handed. */
+  if (prompt_cache.local_prompt != saved_local_prompt)
+    FREE (prompt_cache.local_prompt);
+  if (prompt_cache.local_prompt_prefix != saved_local_prefix)
+    FREE (prompt_cache.local_prompt_prefix);
+
+  prompt_cache.prompt = (char *)xmalloc (len + 1);
+  memcpy (prompt_cache.prompt, prompt, len + 1);
+  prompt_cache.len = len;
+  prompt_cache.hash = hash;
+  prompt_cache.is_rl_prompt = prompt == rl_prompt;
+
+  ms = _rl_show_mode_in_prompt ? prompt_modestr (&mlen) : 0;
+  if (ms)
+    {
+      prompt_cache.modestr = (char *)xmalloc (mlen + 1);
+      memcpy (prompt_cache.modestr, ms, mlen);
+      prompt_cache.modestr[mlen] = '\0';
+    }
+  else
+    {
+      prompt_cache.modestr = (char *)NULL;
+      mlen = 0;
+    }
+  prompt_cache.modestr_len = mlen;
+
+  prompt_cache.screenwidth = _rl_screenwidth;
+  prompt_cache.mb_cur_max = MB_CUR_MAX;
+  prompt_cache.byte_oriented = rl_byte_oriented;
+  prompt_cache.utf8locale = _rl_utf8locale;
+
+  prompt_cache.local_prompt = local_prompt;
+  prompt_cache.local_prompt_prefix = local_prompt_prefix;
+
+  for (n = 0; n < local_prompt_newlines_size && local_prompt_newlines[n] != -1; n++)
+    ;
+  if (n < local_prompt_newlines_size)
+    n++;				/* keep the -1 */
+  prompt_cache.newlines = (int *)xrealloc (prompt_cache.newlines, sizeof (int) * (n + 1));
+  memcpy (prompt_cache.newlines, local_prompt_newlines, sizeof (int) * n);
+  prompt_cache.newlines[n] = -1;
+  prompt_cache.nnewlines = n;
+
+  prompt_cache.local_prompt_len = local_prompt_len;
+  prompt_cache.visible_length = prompt_visible_length;
+  prompt_cache.prefix_length = prompt_prefix_length;
+  prompt_cache.last_invisible = prompt_last_invisible;
+  prompt_cache.invis_chars_first_line = prompt_invis_chars_first_line;
+  prompt_cache.physical_chars = prompt_physical_chars;
+  prompt_cache.retval = retval;
+
+  prompt_cache.valid = 1;
+}
+
+/* Set the expanded prompt variables from the cache and return the value
+   rl_expand_prompt returned when the cache was filled.  local_prompt and
+   local_prompt_prefix are the cache's strings afterwards. */
+static int
+prompt_cache_restore (void)
+{
+  local_prompt = prompt_cache.local_prompt;
+  local_prompt_prefix = prompt_cache.local_prompt_prefix;
+
+  if (local_prompt_newlines_size < prompt_cache.nnewlines + 1)
+    {
+      local_prompt_newlines = (int *)xrealloc (local_prompt_newlines, sizeof (int) * (prompt_cache.nnewlines + 1));
+      local_prompt_newlines_size = prompt_cache.nnewlines + 1;
+    }
+  memcpy (local_prompt_newlines, prompt_cache.newlines, sizeof (int) * (prompt_cache.nnewlines + 1));
+
+  local_prompt_len = prompt_cache.local_prompt_len;
+  prompt_visible_length = prompt_cache.visible_length;
+  if (local_prompt_prefix)
+    prompt_prefix_length = prompt_cache.prefix_length;
+  prompt_last_invisible = prompt_cache.last_invisible;
+  prompt_invis_chars_first_line = prompt_cache.invis_chars_first_line;
+  prompt_physical_chars = prompt_cache.physical_chars;
+
+  return (prompt_cache.retval);
+}
+
+/* Free local_prompt and local_prompt_prefix, unless they are the strings
+   the prompt cache handed out. */
+static void
+free_local_prompt (void)
+{
+  if (local_prompt != prompt_cache.local_prompt)
+    FREE (local_prompt);
+  if (local_prompt_prefix != prompt_cache.local_prompt_prefix)
+    FREE (local_prompt_prefix);
+  local_prompt = local_prompt_prefix = (char *)NULL;
+}
+
 /*
  * Expand the prompt string into the various display components, if
  * necessary.
@@ -585,13 +819,13 @@ int
 rl_expand_prompt (char *prompt)
 {
   char *p, *t;
-  int c;
+  int c, r;
+  size_t len;
+  unsigned long hash;
 
   /* Clear out any saved values. */
-  FREE (local_prompt);
-  FREE (local_prompt_prefix);
+  free_local_prompt ();
 
-  local_prompt = local_prompt_prefix = (char *)0;
   local_prompt_len = 0;
   prompt_last_invisible = prompt_invis_chars_first_line = 0;
   prompt_visible_length = prompt_physical_chars = 0;
@@ -599,6 +833,15 @@ rl_expand_prompt (char *prompt)
   if (prompt == 0 || *prompt == 0)
     return (0);
 
+  /* expand_prompt would do this anyway; the width is part of the key. */
+  if (_rl_screenwidth == 0)
+    _rl_get_screen_size (0, 0);
+
+  len = strlen (prompt);
+  hash = prompt_hash (prompt, len);
+  if (prompt_cache_valid (prompt, len, hash))
+    return (prompt_cache_restore ());
+
   p = strrchr (prompt, '\n');
   if (p == 0)
     {
@@ -609,7 +852,7 @@ rl_expand_prompt (char *prompt)
 					       &prompt_physical_chars);
       local_prompt_prefix = (char *)0;
       local_prompt_len = local_prompt ? strlen (local_prompt) : 0;
-      return (prompt_visible_length);
+      r = prompt_visible_length;
     }
   else
     {
@@ -631,8 +874,11 @@ rl_expand_prompt (char *prompt)
 				       &prompt_invis_chars_first_line,
 				       &prompt_physical_chars);
       local_prompt_len = local_prompt ? strlen (local_prompt) : 0;
-      return (prompt_prefix_length);
+      r = prompt_prefix_length;
     }
+
+  prompt_cache_save (prompt, len, hash, r);
+  return (r);
 }
 
 /* Allocate the various line structures, making sure they can hold MINSIZE
@@ -744,6 +990,115 @@ set_active_region (int *beg, int *end)
     }
 }
 
+/* Make sure LS has room for the line breaks and checkpoints of screen
+   lines 0 through N. */
+static void
+realloc_line_breaks (struct line_state *ls, int n)
+{
+  while (n >= ls->lbsize - 2)
+    {
+      ls->lbsize *= 2;
+      ls->lbreaks = (int *)xrealloc (ls->lbreaks, ls->lbsize * sizeof (int));
+    }
+#if defined (HANDLE_MULTIBYTE)
+  while (n >= ls->wbsize - 2)
+    {
+      ls->wbsize *= 2;
+      ls->wrapped_line = (int *)xrealloc (ls->wrapped_line, ls->wbsize * sizeof (int));
+    }
+#endif
+  if (n >= ls->cpsize)
+    {
+      ls->cpsize = ls->cpsize ? ls->cpsize : 64;
+      while (n >= ls->cpsize)
+	ls->cpsize *= 2;
+      ls->checkpoints = (struct line_checkpoint *)xrealloc (ls->checkpoints, ls->cpsize * sizeof (struct line_checkpoint));
+    }
+}
+
+/* Note that the line buffer is about to change from index POS on. */
+void
+_rl_redisplay_damage (int pos)
+{
+  if (pos < 0)
+    pos = 0;
+  if (redisplay_damage < 0 || pos < redisplay_damage)
+    redisplay_damage = pos;
+  if (_rl_line_damage < 0 || pos < _rl_line_damage)
+    _rl_line_damage = pos;
+}
+
+/* Decide whether rl_redisplay can draw the line buffer starting from one of
+   the visible line's checkpoints.  OUT, LPOS and NEWLINES describe the
+   prompt just drawn into the invisible line.  Returns the screen line to
+   start from, or 0 to draw everything.  *COMMONP gets the length of the
+   prefix of the buffer known to be the same as DRAWN_LINE; *SAMEP is set
+   if that is all of it. */
+static int
+redisplay_resume_line (int out, int lpos, int newlines, int *commonp, int *samep)
+{
+  int mb_cur_max, limit, line;
+  struct line_checkpoint *cp;
+
+  *commonp = *samep = 0;
+  mb_cur_max = MB_CUR_MAX;
+  if (drawn_layout.valid == 0 || forced_display || rl_display_fixed)
+    return 0;
+  if (_rl_horizontal_scroll_mode || _rl_term_up == 0 || *_rl_term_up == 0 || rl_mark_active_p ())
+    return 0;
+  if (drawn_layout.screenwidth != _rl_screenwidth ||
+	drawn_layout.prompt_out != out ||
+	drawn_layout.prompt_lpos != lpos ||
+	drawn_layout.prompt_lines != newlines ||
+	drawn_layout.wrap_offset != wrap_offset ||
+	drawn_layout.mb_cur_max != mb_cur_max ||
+	drawn_layout.byte_oriented != rl_byte_oriented ||
+	drawn_layout.meta != _rl_output_meta_chars)
+    return 0;
+  /* Decoding can only restart in the middle of the buffer if the encoding
+     has no shift states. */
+  if (mb_cur_max > 1 && rl_byte_oriented == 0 && _rl_utf8locale == 0)
+    return 0;
+  if (memcmp (invisible_line, visible_line, out) != 0)
+    return 0;
+
+  limit = (redisplay_damage >= 0 && redisplay_damage < rl_end) ? redisplay_damage : rl_end;
+  if (limit > drawn_len)
+    limit = drawn_len;
+  if (memcmp (drawn_line, rl_line_buffer, limit) != 0)
+    return 0;
+  *commonp = limit;
+  *samep = limit == rl_end && rl_end == drawn_len;
+
+  /* A character that ends just before the checkpoint has to have been
+     decoded the same way both times, so stay a character clear of the
+     change.  The cursor position is found by the drawing loop. */
+  if (mb_cur_max > 1 && rl_byte_oriented == 0)
+    limit -= mb_cur_max;
+  if (rl_point < limit)
+    limit = rl_point;
+
+  for (line = line_state_visible->cpcount - 1; line > newlines; line--)
+    {
+      cp = line_state_visible->checkpoints + line;
+      if (cp->in >= 0 && cp->in <= limit && line <= _rl_vis_botlin)
+	return line;
+    }
+  return 0;
+}
+
+/* Draw the line if its last redisplay was put off because more input was
+   waiting, before something else goes to the terminal below it. */
+void
+_rl_flush_redisplay (void)
+{
+  if (_rl_redisplay_deferred)
+    {
+      (*rl_redisplay_function) ();
+      _rl_redisplay_deferred = 0;
+    }
+}
+
 /* Do whatever tests are necessary and tell update_line that it can do a
    quick, dumb redisplay on the assumption that there are so many
    differences between the old and new lines that it would be a waste to
@@ -768,6 +1123,10 @@ rl_redisplay (void)
   char *prompt_this_line;
   char cur_face;
   int hl_begin, hl_end;
+  int start_line, last_checkpoint, drawn_common, drawn_same, resumable;
+  int prompt_out, prompt_lpos;
+  int text_out, text_lpos, text_lines;
+  struct line_checkpoint *cp, *vcp;
   int mb_cur_max = MB_CUR_MAX;
 #if defined (HANDLE_MULTIBYTE)
   WCHAR_T wc;
@@ -775,8 +1134,10 @@ rl_redisplay (void)
   int wc_width;
   mbstate_t ps;
   int _rl_wrapped_multicolumn = 0;
+  int text_wrapped;
 #endif
 
+  _rl_redisplay_deferred = 0;
   if (_rl_echoing_p == 0)
     return;
 
@@ -784,6 +1145,8 @@ rl_redisplay (void)
      data structures. */
   _rl_block_sigint ();  
   RL_SETSTATE (RL_STATE_REDISPLAYING);
+  _rl_frame_begin ();
+  rl_redisplay_stats.frame_lines = 0;
 
   cur_face = FACE_NORMAL;
   /* Can turn this into an array for multiple highlighted objects in addition
@@ -989,6 +1352,37 @@ rl_redisplay (void)
     }
 
   prompt_last_screen_line = newlines;
+  prompt_out = out;
+  prompt_lpos = lpos;
+
+  /* If only the end of a long line changed, start from the checkpoint of
+     the first screen line that could look different and take the lines
+     above it from the visible line. */
+  realloc_line_breaks (line_state_invisible, newlines);
+  in = 0;
+  start_line = redisplay_resume_line (out, lpos, newlines, &drawn_common, &drawn_same);
+  if (start_line > 0)
+    {
+      cp = line_state_visible->checkpoints + start_line;
+      realloc_line_breaks (line_state_invisible, start_line);
+      memcpy (invisible_line, visible_line, cp->out);
+      memcpy (inv_face, vis_face, cp->out);
+      memcpy (inv_lbreaks, vis_lbreaks, (start_line + 1) * sizeof (int));
+      memcpy (line_state_invisible->checkpoints, line_state_visible->checkpoints, (start_line + 1) * sizeof (struct line_checkpoint));
+#if defined (HANDLE_MULTIBYTE)
+      memcpy (line_state_invisible->wrapped_line, line_state_visible->wrapped_line, start_line * sizeof (int));
+      line_state_invisible->wrapped_line[start_line] = cp->wbreak;
+      _rl_wrapped_multicolumn = cp->wrapped;
+#endif
+      in = cp->in;
+      out = cp->out;
+      lpos = cp->lpos;
+      newlines = start_line;
+    }
+  else
+    for (temp = 0; temp <= newlines; temp++)
+      line_state_invisible->checkpoints[temp].in = -1;
+  last_checkpoint = newlines;
 
   /* Draw the rest of the line (after the prompt) into invisible_line, keeping
      track of where the cursor is (cpos_buffer_position), the number of the
@@ -998,25 +1392,68 @@ rl_redisplay (void)
      This handles expanding tabs for display and displaying meta characters. */
   lb_linenum = 0;
 #if defined (HANDLE_MULTIBYTE)
-  in = 0;
   if (mb_cur_max > 1 && rl_byte_oriented == 0)
     {
       memset (&ps, 0, sizeof (mbstate_t));
-      if (_rl_utf8locale && UTF8_SINGLEBYTE(rl_line_buffer[0]))
+      if (_rl_utf8locale && UTF8_SINGLEBYTE(rl_line_buffer[in]))
 	{
-	  wc = (WCHAR_T)rl_line_buffer[0];
+	  wc = (WCHAR_T)rl_line_buffer[in];
 	  wc_bytes = 1;
 	}
       else
-	wc_bytes = MBRTOWC (&wc, rl_line_buffer, rl_end, &ps);
+	wc_bytes = MBRTOWC (&wc, rl_line_buffer + in, rl_end - in, &ps);
     }
   else
     wc_bytes = 1;
   while (in < rl_end)
 #else
-  for (in = 0; in < rl_end; in++)
+  for ( ; in < rl_end; in++)
 #endif
     {
+      /* Remember where each screen line starts for the next redisplay. */
+      if (newlines > last_checkpoint)
+	{
+	  realloc_line_breaks (line_state_invisible, newlines);
+	  while (++last_checkpoint < newlines)
+	    line_state_invisible->checkpoints[last_checkpoint].in = -1;
+	  cp = line_state_invisible->checkpoints + newlines;
+	  cp->in = in;
+	  cp->out = out;
+	  cp->lpos = lpos;
+#if defined (HANDLE_MULTIBYTE)
+	  cp->wrapped = _rl_wrapped_multicolumn;
+	  cp->wbreak = line_state_invisible->wrapped_line[newlines];
+#else
+	  cp->wrapped = cp->wbreak = 0;
+#endif
+
+	  /* Past the cursor in an unchanged buffer, the rest of the line
+	     comes out the same as last time once a line starts the same. */
+	  vcp = line_state_visible->checkpoints + newlines;
+	  if (drawn_same && rl_point < in &&
+		newlines < line_state_visible->cpcount && vcp->in == cp->in &&
+		vcp->out == cp->out && vcp->lpos == cp->lpos &&
+		vcp->wrapped == cp->wrapped && vcp->wbreak == cp->wbreak)
+	    {
+	      temp = drawn_layout.text_lines;
+	      realloc_line_breaks (line_state_invisible, temp);
+	      memcpy (invisible_line + out, visible_line + out, drawn_layout.text_out - out);
+	      memcpy (inv_face + out, vis_face + out, drawn_layout.text_out - out);
+	      memcpy (inv_lbreaks + newlines + 1, vis_lbreaks + newlines + 1, (temp - newlines) * sizeof (int));
+	      last_checkpoint = line_state_visible->cpcount - 1;
+	      memcpy (line_state_invisible->checkpoints + newlines + 1, vcp + 1, (last_checkpoint - newlines) * sizeof (struct line_checkpoint));
+#if defined (HANDLE_MULTIBYTE)
+	      memcpy (line_state_invisible->wrapped_line + newlines + 1, line_state_visible->wrapped_line + newlines + 1, (temp - newlines) * sizeof (int));
+	      _rl_wrapped_multicolumn = drawn_layout.text_wrapped;
+#endif
+	      in = rl_end;
+	      out = drawn_layout.text_out;
+	      lpos = drawn_layout.text_lpos;
+	      newlines = temp;
+	      break;
+	    }
+	}
+
       if (in == hl_begin)
 	cur_face = FACE_STANDOUT;
       else if (in == hl_end)
@@ -1190,13 +1627,82 @@ rl_redisplay (void)
         in++;
 #endif
     }
-  invis_nul (&out);
-  line_totbytes = out;
   if (cpos_buffer_position < 0)
     {
       cpos_buffer_position = out;
       lb_linenum = newlines;
     }
+  line_state_invisible->cpcount = last_checkpoint + 1;
+  text_out = out;
+  text_lpos = lpos;
+  text_lines = newlines;
+#if defined (HANDLE_MULTIBYTE)
+  text_wrapped = _rl_wrapped_multicolumn;
+#endif
+
+  /* Only the part of the buffer past DRAWN_COMMON can differ from the
+     copy. */
+  if (rl_end >= drawn_size)
+    {
+      drawn_size = rl_end + 256;
+      drawn_line = (char *)xrealloc (drawn_line, drawn_size);
+    }
+  if (rl_end > drawn_common)
+    memcpy (drawn_line + drawn_common, rl_line_buffer + drawn_common, rl_end - drawn_common);
+  drawn_len = rl_end;
+  redisplay_damage = -1;
+
+  /* Draw the suggestion, if any, after the end of the line.  The cursor
+     position was set above, so it stays at the end of the real text. */
+  suggestion_displayed = 0;
+  if (_rl_suggestion && *_rl_suggestion && rl_point == rl_end)
+    {
+      const char *sugg;
+      int sugg_len, sugg_in, sugg_bytes, i;
+
+      sugg = _rl_suggestion;
+      sugg_len = strlen (sugg);
+      for (sugg_in = 0; sugg_in < sugg_len; sugg_in += sugg_bytes)
+	{
+	  c = (unsigned char)sugg[sugg_in];
+#if defined (HANDLE_MULTIBYTE)
+	  if (mb_cur_max > 1 && rl_byte_oriented == 0)
+	    {
+	      memset (&ps, 0, sizeof (mbstate_t));
+	      wc_bytes = MBRTOWC (&wc, sugg + sugg_in, sugg_len - sugg_in, &ps);
+	      if (MB_INVALIDCH (wc_bytes) || MB_NULLWCH (wc_bytes))
+		break;
+	      wc_width = WCWIDTH (wc);
+	      if (wc_width < 0)
+		break;
+	      sugg_bytes = wc_bytes;
+
+	      _rl_wrapped_multicolumn = 0;
+	      if (_rl_screenwidth < lpos + wc_width)
+		for (i = lpos; i < _rl_screenwidth; i++)
+		  {
+		    invis_addc (&out, ' ', FACE_SUGGESTION);
+		    _rl_wrapped_multicolumn++;
+		    CHECK_LPOS();
+		  }
+	      invis_adds (&out, sugg + sugg_in, sugg_bytes, FACE_SUGGESTION);
+	      for (i = 0; i < wc_width; i++)
+		CHECK_LPOS();
+	      suggestion_displayed = 1;
+	      continue;
+	    }
+#endif
+	  sugg_bytes = 1;
+	  if (META_CHAR (c) || CTRL_CHAR (c) || c == RUBOUT)
+	    break;
+	  invis_addc (&out, c, FACE_SUGGESTION);
+	  CHECK_LPOS();
+	  suggestion_displayed = 1;
+	}
+    }
+
+  invis_nul (&out);
+  line_totbytes = out;
 
   /* If we are switching from one line to multiple wrapped lines, we don't
      want to do a dumb update (or we want to make it smarter). */
@@ -1224,6 +1730,7 @@ rl_redisplay (void)
      otherwise, let long lines display in a single terminal line, and
      horizontally scroll it. */
   displaying_prompt_first_line = 1;
+  resumable = 0;
   if (_rl_horizontal_scroll_mode == 0 && _rl_term_up && *_rl_term_up)
     {
       int nleft, pos, changed_screen_line, tx;
@@ -1243,6 +1750,7 @@ rl_redisplay (void)
 	      else
 #endif
 		out = _rl_screenchars - 1;
+	      start_line = 0;
 	    }
 
 	  /* The first line is at character position 0 in the buffer.  The
@@ -1283,8 +1791,11 @@ rl_redisplay (void)
 		norm_face (INV_LINE_FACE(linenum), INV_LLEN (linenum));
 	    }
 
-	  /* For each line in the buffer, do the updating display. */
-	  for (linenum = 0; linenum <= inv_botlin; linenum++)
+	  /* For each line in the buffer, do the updating display.  Lines
+	     before START_LINE were copied from the visible line and are
+	     already on the screen. */
+	  rl_redisplay_stats.frame_lines = inv_botlin + 1 - start_line;
+	  for (linenum = start_line; linenum <= inv_botlin; linenum++)
 	    {
 	      /* This can lead us astray if we execute a program that changes
 		 the locale from a non-multibyte to a multibyte one. */
@@ -1389,6 +1900,7 @@ rl_redisplay (void)
 		}
 	    }
 	  _rl_vis_botlin = inv_botlin;
+	  resumable = line_totbytes < _rl_screenchars && hl_begin < 0 && rl_mark_active_p () == 0;
 
 	  /* CHANGED_SCREEN_LINE is set to 1 if we have moved to a
 	     different screen line during this redisplay. */
@@ -1534,6 +2046,7 @@ rl_redisplay (void)
       if (rl_display_fixed == 0 || forced_display || lmargin != last_lmargin)
 	{
 	  forced_display = 0;
+	  rl_redisplay_stats.frame_lines = 1;
 	  o_cpos = _rl_last_c_pos;
 	  cpos_adjusted = 0;
 	  update_line (&visible_line[last_lmargin], &vis_face[last_lmargin],
@@ -1566,7 +2079,7 @@ rl_redisplay (void)
 	  last_lmargin = lmargin;
 	}
     }
-  fflush (rl_outstream);
+  _rl_frame_end ();
 
   /* Swap visible and non-visible lines. */
   {
@@ -1585,6 +2098,22 @@ rl_redisplay (void)
       visible_wrap_offset = wrap_offset;
 
     _rl_quick_redisplay = 0;
+
+    drawn_layout.valid = resumable;
+    drawn_layout.screenwidth = _rl_screenwidth;
+    drawn_layout.prompt_out = prompt_out;
+    drawn_layout.prompt_lpos = prompt_lpos;
+    drawn_layout.prompt_lines = prompt_last_screen_line;
+    drawn_layout.wrap_offset = wrap_offset;
+    drawn_layout.mb_cur_max = mb_cur_max;
+    drawn_layout.byte_oriented = rl_byte_oriented;
+    drawn_layout.meta = _rl_output_meta_chars;
+    drawn_layout.text_out = text_out;
+    drawn_layout.text_lpos = text_lpos;
+    drawn_layout.text_lines = text_lines;
+#if defined (HANDLE_MULTIBYTE)
+    drawn_layout.text_wrapped = text_wrapped;
+#endif
   }
 
   RL_UNSETSTATE (RL_STATE_REDISPLAYING);
@@ -1598,18 +2127,22 @@ putc_face (int c, int face, char *cur_face)
   cf = *cur_face;
   if (cf != face)
     {
-      if (cf != FACE_NORMAL && cf != FACE_STANDOUT)
+      if (cf != FACE_NORMAL && cf != FACE_STANDOUT && cf != FACE_SUGGESTION)
 	return;
-      if (face != FACE_NORMAL && face != FACE_STANDOUT)
+      if (face != FACE_NORMAL && face != FACE_STANDOUT && face != FACE_SUGGESTION)
 	return;
-      if (face == FACE_STANDOUT && cf == FACE_NORMAL)
-	_rl_region_color_on ();
-      if (face == FACE_NORMAL && cf == FACE_STANDOUT)
+      if (cf == FACE_STANDOUT)
 	_rl_region_color_off ();
+      else if (cf == FACE_SUGGESTION)
+	_rl_suggestion_color_off ();
+      if (face == FACE_STANDOUT)
+	_rl_region_color_on ();
+      else if (face == FACE_SUGGESTION)
+	_rl_suggestion_color_on ();
       *cur_face = face;
     }
   if (c != EOF)
-    putc (c, rl_outstream);
+    _rl_output_character_function (c);
 }
 
 static void
@@ -1832,7 +2365,7 @@ update_line (char *old, char *old_face, char *new, char *new_face, int current_l
 	    }
 	  else
 	    {
-	      putc (' ', rl_outstream);
+	      _rl_output_character_function (' ');
 	      _rl_last_c_pos = 1;
 	      _rl_last_v_pos++;
 	      if (old[0] && new[0])
@@ -1848,7 +2381,7 @@ update_line (char *old, char *old_face, char *new, char *new_face, int current_l
 	  if (new[0])
 	    puts_face (new, new_face, 1);
 	  else
-	    putc (' ', rl_outstream);
+	    _rl_output_character_function (' ');
 	  _rl_last_c_pos = 1;
 	  _rl_last_v_pos++;
 	  if (old[0] && new[0])
@@ -2588,6 +3121,7 @@ rl_on_new_line (void)
   if (vis_lbreaks)
     vis_lbreaks[0] = vis_lbreaks[1] = 0;
   visible_wrap_offset = 0;
+  drawn_layout.valid = 0;
   return 0;
 }
 
@@ -2601,6 +3135,7 @@ rl_clear_visible_line (void)
   /* Make sure we move to column 0 so we clear the entire line */
   _rl_cr ();
   _rl_last_c_pos = 0;
+  drawn_layout.valid = 0;
 
   /* Move to the last screen line of the current visible line */
   _rl_move_vert (_rl_vis_botlin);
@@ -2637,6 +3172,7 @@ rl_on_new_line_with_prompt (void)
   lprompt = local_prompt ? local_prompt : rl_prompt;
   strcpy (visible_line, lprompt);
   strcpy (invisible_line, lprompt);
+  drawn_layout.valid = 0;
 
   /* If the prompt contains newlines, take the last tail. */
   prompt_last_line = strrchr (rl_prompt, '\n');
@@ -2872,7 +3408,7 @@ _rl_move_vert (int to)
   if ((delta = to - _rl_last_v_pos) > 0)
     {
       for (i = 0; i < delta; i++)
-	putc ('\n', rl_outstream);
+	_rl_output_character_function ('\n');
       _rl_cr ();
       _rl_last_c_pos = 0;
     }
@@ -3007,11 +3543,7 @@ rl_message (va_alist)
       msg_saved_prompt = 1;
     }
   else if (local_prompt != saved_local_prompt)
-    {
-      FREE (local_prompt);
-      FREE (local_prompt_prefix);
-      local_prompt = (char *)NULL;
-    }
+    free_local_prompt ();
   rl_display_prompt = msg_buf;
   local_prompt = expand_prompt (msg_buf, 0, &prompt_visible_length,
 					    &prompt_last_invisible,
@@ -3041,11 +3573,7 @@ rl_message (format, arg1, arg2)
       msg_saved_prompt = 1;
     }
   else if (local_prompt != saved_local_prompt)
-    {
-      FREE (local_prompt);
-      FREE (local_prompt_prefix);
-      local_prompt = (char *)NULL;
-    }
+    free_local_prompt ();
   local_prompt = expand_prompt (msg_buf, 0, &prompt_visible_length,
 					    &prompt_last_invisible,
 					    &prompt_invis_chars_first_line,
@@ -3098,10 +3626,12 @@ rl_save_prompt (void)
   saved_invis_chars_first_line = prompt_invis_chars_first_line;
   saved_physical_chars = prompt_physical_chars;
   saved_local_prompt_newlines = local_prompt_newlines;
+  saved_local_prompt_newlines_size = local_prompt_newlines_size;
 
   local_prompt = local_prompt_prefix = (char *)0;
   local_prompt_len = 0;
   local_prompt_newlines = (int *)0;
+  local_prompt_newlines_size = 0;
 
   prompt_last_invisible = prompt_visible_length = prompt_prefix_length = 0;
   prompt_invis_chars_first_line = prompt_physical_chars = 0;
@@ -3110,14 +3640,14 @@ rl_save_prompt (void)
 void
 rl_restore_prompt (void)
 {
-  FREE (local_prompt);
-  FREE (local_prompt_prefix);
+  free_local_prompt ();
   FREE (local_prompt_newlines);
 
   local_prompt = saved_local_prompt;
   local_prompt_prefix = saved_local_prefix;
   local_prompt_len = saved_local_length;
   local_prompt_newlines = saved_local_prompt_newlines;
+  local_prompt_newlines_size = saved_local_prompt_newlines_size;
 
   prompt_prefix_length = saved_prefix_length;
   prompt_last_invisible = saved_last_invisible;
@@ -3131,6 +3661,7 @@ rl_restore_prompt (void)
   saved_last_invisible = saved_visible_length = saved_prefix_length = 0;
   saved_invis_chars_first_line = saved_physical_chars = 0;
   saved_local_prompt_newlines = 0;
+  saved_local_prompt_newlines_size = 0;
 }
 
 char *
@@ -3178,11 +3709,12 @@ _rl_erase_at_end_of_line (int l)
 
   _rl_backspace (l);
   for (i = 0; i < l; i++)
-    putc (' ', rl_outstream);
+    _rl_output_character_function (' ');
   _rl_backspace (l);
   for (i = 0; i < l; i++)
     visible_line[--_rl_last_c_pos] = '\0';
   rl_display_fixed++;
+  drawn_layout.valid = 0;
 }
 
 /* Clear to the end of the line.  COUNT is the minimum
@@ -3208,7 +3740,7 @@ space_to_eol (int count)
   register int i;
 
   for (i = 0; i < count; i++)
-    putc (' ', rl_outstream);
+    _rl_output_character_function (' ');
 
   _rl_last_c_pos += count;
 }
@@ -3229,6 +3761,7 @@ _rl_clear_screen (int clrscr)
   else
     rl_crlf ();
 #endif /* __DJGPP__ */
+  drawn_layout.valid = 0;
 }
 
 /* Insert COUNT characters from STRING to the output stream at column COL. */
@@ -3308,6 +3841,15 @@ _rl_update_final (void)
   if (line_structures_initialized == 0)
     return;
 
+  /* A suggestion isn't part of the line; take it off the screen before
+     leaving the line so it isn't left behind. */
+  if (suggestion_displayed)
+    {
+      _rl_suggestion = (char *)NULL;
+      (*rl_redisplay_function) ();
+    }
+  _rl_flush_redisplay ();
+
   full_lines = 0;
   /* If the cursor is the only thing on an otherwise-blank last line,
      compensate so we don't print an extra CRLF. */
@@ -3341,6 +3883,7 @@ _rl_update_final (void)
   if ((_rl_vis_botlin == 0 && botline_length == 0) || botline_length > 0 || _rl_last_c_pos > 0)
     rl_crlf ();
   _rl_vis_botlin = 0;
+  drawn_layout.valid = 0;
   fflush (rl_outstream);
   rl_display_fixed++;
 }
@@ -3417,6 +3960,7 @@ _rl_clean_up_for_exit (void)
       if (_rl_vis_botlin > 0)	/* minor optimization plus bug fix */
 	_rl_move_vert (_rl_vis_botlin);
       _rl_vis_botlin = 0;
+      drawn_layout.valid = 0;
       fflush (rl_outstream);
       rl_restart_output (1, 0);
     }
@@ -3428,6 +3972,7 @@ _rl_erase_entire_line (void)
   cr ();
   _rl_clear_to_eol (0);
   cr ();
+  drawn_layout.valid = 0;
   fflush (rl_outstream);
 }
 
@@ -3468,6 +4013,28 @@ _rl_refresh_line (void)
 }
 
 #if defined (HANDLE_MULTIBYTE)
+/* Return the number of bytes at the start of the LEN bytes at S that are
+   ASCII characters other than NUL, looking at a word at a time. */
+static int
+ascii_span (const char *s, int len)
+{
+  unsigned long w, ones, highs;
+  int i;
+
+  ones = (unsigned long)-1 / 0xff;	/* 0x0101...01 */
+  highs = ones << 7;			/* 0x8080...80 */
+  for (i = 0; i + (int)sizeof (w) <= len; i += sizeof (w))
+    {
+      memcpy (&w, s + i, sizeof (w));
+      /* Stop at a word with a byte that is zero or has the high bit set. */
+      if (((w | ((w - ones) & ~w)) & highs) != 0)
+	break;
+    }
+  while (i < len && s[i] && UTF8_SINGLEBYTE (s[i]))
+    i++;
+  return i;
+}
+
 /* Calculate the number of screen columns occupied by STR from START to END.
    In the case of multibyte characters with stateful encoding, we have to
    scan from the beginning of the string to take the state into account. */
@@ -3508,7 +4075,9 @@ _rl_col_width (const char *str, int start, int end, int flags)
       if (_rl_utf8locale && UTF8_SINGLEBYTE(str[point]))
 	{
 	  memset (&ps, 0, sizeof (mbstate_t));
-	  tmp = 1;
+	  tmp = ascii_span (str + point, start - point);
+	  if (tmp == 0)
+	    tmp = 1;		/* NUL */
 	}
       else
 	tmp = mbrlen (str + point, max, &ps);
@@ -3540,6 +4109,14 @@ _rl_col_width (const char *str, int start, int end, int flags)
 
   while (point < end)
     {
+      /* Each printable or control ASCII character takes one column. */
+      if (_rl_utf8locale && (tmp = ascii_span (str + point, end - point)) > 0)
+	{
+	  point += tmp;
+	  max -= tmp;
+	  width += tmp;
+	  continue;
+	}
       if (_rl_utf8locale && UTF8_SINGLEBYTE(str[point]))
 	{
 	  tmp = 1;
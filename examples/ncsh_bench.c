@@ -0,0 +1,735 @@
+/* ncsh bench - microbenchmarks for the autocompletion prefix tree and the arena */
+
+/* Copyright (C) ncsh by Alex Eski 2025 */
+
+/* This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+/* usage: ncsh_bench [-n max_entries] [-r repetitions] [-s seed] [-f history_file]
+ *
+ * Runs each benchmark over synthetic corpora of 1k, 10k, 100k... entries up to max_entries, and over the lines of
+ * history_file if one is given. Every benchmark is repeated and the fastest repetition is reported, as ns per operation,
+ * with the nodes and arena bytes of the tree and, when perf_event_open is available, cache misses per operation.
+ * Rows that report other bytes say so where they are run.
+ * The synthetic corpora only depend on the seed, so runs on different builds can be compared line for line.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#   include <linux/perf_event.h>
+#   include <sys/ioctl.h>
+#   include <sys/syscall.h>
+#endif // __linux__
+
+#include "ncsh_arena.h"
+#include "ncsh_autocompletions.h"
+#include "ncsh_string.h"
+
+#ifdef NCSH_AUTOCOMPLETIONS_DENSE
+#   define NCSH_BENCH_LAYOUT "dense"
+#else
+#   define NCSH_BENCH_LAYOUT "compact"
+#endif // NCSH_AUTOCOMPLETIONS_DENSE
+
+#define NCSH_BENCH_MAX_ENTRIES 1000000
+
+#define NCSH_BENCH_QUERIES 100000
+#define NCSH_BENCH_FUZZY_QUERIES 1000 // a fuzzy query can walk a large part of the tree, so fewer of them
+#define NCSH_BENCH_TYPED 16 // room for a typed query and its typo
+#define NCSH_BENCH_ALLOCATIONS 1000000
+#define NCSH_BENCH_BUFFER_BYTES 4096
+
+struct ncsh_Bench_Corpus {
+    const char* name;
+    struct ncsh_String* entries;
+    size_t count;
+};
+
+struct ncsh_Bench_Result {
+    double ns;
+    double misses; // per operation, negative if cache misses can't be counted
+};
+
+/* cache misses */
+static int perf_fd = -1;
+
+static void bench_perf_open(void)
+{
+#if defined(__linux__)
+    struct perf_event_attr attr = {
+        .type = PERF_TYPE_HARDWARE,
+        .size = sizeof(attr),
+        .config = PERF_COUNT_HW_CACHE_MISSES,
+        .disabled = 1,
+        .exclude_kernel = 1,
+        .exclude_hv = 1,
+    };
+    perf_fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#endif // __linux__
+}
+
+static void bench_perf_start(void)
+{
+#if defined(__linux__)
+    if (perf_fd >= 0) {
+        ioctl(perf_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(perf_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif // __linux__
+}
+
+static int64_t bench_perf_stop(void)
+{
+    int64_t misses = -1;
+#if defined(__linux__)
+    if (perf_fd >= 0) {
+        ioctl(perf_fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(perf_fd, &misses, sizeof(misses)) != sizeof(misses)) {
+            misses = -1;
+        }
+    }
+#endif // __linux__
+    return misses;
+}
+
+static double bench_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec * 1e9 + (double)now.tv_nsec;
+}
+
+/* xorshift64*, so the corpora are the same on every platform */
+static uint64_t bench_seed;
+
+static uint64_t bench_random(void)
+{
+    bench_seed ^= bench_seed >> 12;
+    bench_seed ^= bench_seed << 25;
+    bench_seed ^= bench_seed >> 27;
+    return bench_seed * 2685821657736338717ULL;
+}
+
+/* corpora */
+static const char* const bench_commands[] = {"git", "make", "ls", "cd", "grep", "vim", "cargo", "docker", "ssh",
+                                             "python3", "kubectl", "cat", "find", "tar", "curl", "sudo"};
+static const char* const bench_words[] = {"status", "commit", "-m", "--all", "build", "test", "src/", "include/",
+                                          "main.c", "readline", "-la", "push", "origin", "master", "run", "-it",
+                                          "ubuntu", "bash", "install", "clean", "get", "pods", "-xzf", "-name"};
+
+#define BENCH_COUNT(array) (sizeof(array) / sizeof((array)[0]))
+
+// commands with a few arguments and a number, skewed so the first commands and words are the most common,
+// like a real history.
+static bool bench_corpus_synthetic(struct ncsh_Bench_Corpus* const corpus, const size_t count)
+{
+    corpus->name = "synthetic";
+    corpus->count = count;
+    corpus->entries = malloc(count * sizeof(struct ncsh_String));
+    if (!corpus->entries) {
+        return false;
+    }
+
+    char line[MAX_INPUT];
+    for (size_t i = 0; i < count; ++i) {
+        size_t command = bench_random() % BENCH_COUNT(bench_commands);
+        command = bench_random() % (command + 1);
+        int length = snprintf(line, sizeof(line), "%s", bench_commands[command]);
+
+        uint64_t arguments = 1 + bench_random() % 4;
+        for (uint64_t j = 0; j < arguments; ++j) {
+            size_t word = bench_random() % BENCH_COUNT(bench_words);
+            word = bench_random() % (word + 1);
+            length += snprintf(line + length, sizeof(line) - (size_t)length, " %s", bench_words[word]);
+        }
+        length += snprintf(line + length, sizeof(line) - (size_t)length, " %lu",
+                           (unsigned long)(bench_random() % (count / 4 + 1)));
+
+        corpus->entries[i].length = (size_t)length + 1;
+        corpus->entries[i].value = malloc(corpus->entries[i].length);
+        if (!corpus->entries[i].value) {
+            corpus->count = i;
+            return false;
+        }
+        memcpy(corpus->entries[i].value, line, corpus->entries[i].length);
+    }
+
+    return true;
+}
+
+// one entry per line, skipping the `#<time>` lines of history files with timestamps.
+static bool bench_corpus_file(struct ncsh_Bench_Corpus* const corpus, const char* const path)
+{
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        return false;
+    }
+
+    corpus->name = path;
+    corpus->count = 0;
+    corpus->entries = NULL;
+    size_t capacity = 0;
+    char* line = NULL;
+    size_t size = 0;
+    ssize_t length;
+    while ((length = getline(&line, &size, file)) >= 0) {
+        if (length && line[length - 1] == '\n') {
+            line[--length] = '\0';
+        }
+        if (!length || length >= MAX_INPUT || (line[0] == '#' && line[1] >= '0' && line[1] <= '9')) {
+            continue;
+        }
+
+        if (corpus->count == capacity) {
+            capacity = capacity ? capacity * 2 : 1024;
+            struct ncsh_String* entries = realloc(corpus->entries, capacity * sizeof(struct ncsh_String));
+            if (!entries) {
+                break;
+            }
+            corpus->entries = entries;
+        }
+        corpus->entries[corpus->count].length = (size_t)length + 1;
+        corpus->entries[corpus->count].value = strdup(line);
+        if (!corpus->entries[corpus->count].value) {
+            break;
+        }
+        ++corpus->count;
+    }
+    free(line);
+    fclose(file);
+
+    return corpus->count > 0;
+}
+
+static void bench_corpus_free(struct ncsh_Bench_Corpus* const corpus)
+{
+    for (size_t i = 0; i < corpus->count; ++i) {
+        free(corpus->entries[i].value);
+    }
+    free(corpus->entries);
+}
+
+/* benchmarks */
+static void bench_report(const struct ncsh_Bench_Corpus* const corpus,
+                         const char* const name,
+                         const struct ncsh_Bench_Result result,
+                         const size_t nodes,
+                         const size_t bytes)
+{
+    printf("%-12s %-8s %8zu %-14s %10.1f", NCSH_BENCH_LAYOUT, corpus->name, corpus->count, name, result.ns);
+    if (nodes) {
+        printf(" %10zu %12zu", nodes, bytes);
+    }
+    else {
+        printf(" %10s %12zu", "-", bytes);
+    }
+    if (result.misses >= 0) {
+        printf(" %10.2f\n", result.misses);
+    }
+    else {
+        printf(" %10s\n", "-");
+    }
+    fflush(stdout);
+}
+
+// keeps the fastest repetition, and the cache misses of that repetition.
+static void bench_keep(struct ncsh_Bench_Result* const best,
+                       const double start,
+                       const int64_t misses,
+                       const size_t operations)
+{
+    double ns = (bench_now() - start) / (double)operations;
+    if (best->ns == 0 || ns < best->ns) {
+        best->ns = ns;
+        best->misses = misses >= 0 ? (double)misses / (double)operations : -1;
+    }
+}
+
+// prefixes of 1 to 6 bytes of random entries, what a user has typed when suggestions are asked for.
+static void bench_queries(const struct ncsh_Bench_Corpus* const corpus, struct ncsh_String* const queries)
+{
+    for (size_t i = 0; i < NCSH_BENCH_QUERIES; ++i) {
+        const struct ncsh_String* entry = &corpus->entries[bench_random() % corpus->count];
+        size_t length = 1 + bench_random() % 6;
+        if (length > entry->length - 1) {
+            length = entry->length - 1;
+        }
+        queries[i].value = entry->value;
+        queries[i].length = length + 1;
+    }
+}
+
+// 2 to 5 characters picked in order from random entries, what a user types to find a command they half remember.
+static void bench_fuzzy_queries(const struct ncsh_Bench_Corpus* const corpus, char (*const queries)[NCSH_BENCH_TYPED])
+{
+    for (size_t i = 0; i < NCSH_BENCH_FUZZY_QUERIES; ++i) {
+        const struct ncsh_String* entry = &corpus->entries[bench_random() % corpus->count];
+        size_t wanted = 2 + bench_random() % 4;
+        size_t length = 0;
+        for (size_t j = 0; j < entry->length - 1 && length < wanted; ++j) {
+            if (entry->value[j] != ' ' && bench_random() % 3 == 0) {
+                queries[i][length++] = entry->value[j];
+            }
+        }
+        if (!length) {
+            queries[i][length++] = entry->value[0];
+        }
+        queries[i][length] = '\0';
+    }
+}
+
+// prefixes of 3 to 8 bytes of random entries with a typo in them: a character changed, dropped, doubled, or swapped
+// with the next one.
+static void bench_edits_queries(const struct ncsh_Bench_Corpus* const corpus, char (*const queries)[NCSH_BENCH_TYPED])
+{
+    for (size_t i = 0; i < NCSH_BENCH_FUZZY_QUERIES; ++i) {
+        const struct ncsh_String* entry = &corpus->entries[bench_random() % corpus->count];
+        size_t length = 3 + bench_random() % 6;
+        if (length > entry->length - 1) {
+            length = entry->length - 1;
+        }
+        char* const query = queries[i];
+        memcpy(query, entry->value, length);
+        size_t typo = bench_random() % length;
+        switch (bench_random() % 4) {
+        case 0:
+            query[typo] = (char)('a' + bench_random() % 26);
+            break;
+        case 1:
+            if (length > 1) {
+                memmove(query + typo, query + typo + 1, length - typo - 1);
+                --length;
+            }
+            break;
+        case 2:
+            memmove(query + typo + 1, query + typo, length - typo);
+            ++length;
+            break;
+        default:
+            if (typo + 1 < length) {
+                char swapped = query[typo];
+                query[typo] = query[typo + 1];
+                query[typo + 1] = swapped;
+            }
+            break;
+        }
+        query[length] = '\0';
+    }
+}
+
+static int bench_compare_ns(const void* lhs, const void* rhs)
+{
+    const double a = *(const double*)lhs;
+    const double b = *(const double*)rhs;
+    return (a > b) - (a < b);
+}
+
+// types each query a character at a time, searching on every keystroke like suggestions shown as they are typed.
+// the result is per keystroke. p99 and slowest are the 99th percentile and the slowest keystroke of the fastest
+// repetition, the slowest includes whatever the scheduler took from it.
+static struct ncsh_Bench_Result bench_keystrokes(char (*const queries)[NCSH_BENCH_TYPED],
+                                                 const bool edits,
+                                                 Autocompletion_Node* const tree,
+                                                 Arena scratch,
+                                                 const int repetitions,
+                                                 double* const p99,
+                                                 double* const slowest,
+                                                 size_t* const found)
+{
+    double* const latencies = malloc(NCSH_BENCH_FUZZY_QUERIES * NCSH_BENCH_TYPED * sizeof(double));
+    if (!latencies) {
+        exit(EXIT_FAILURE);
+    }
+
+    Autocompletion matches[NCSH_MAX_AUTOCOMPLETION_MATCHES];
+    struct ncsh_Bench_Result typed = {0};
+    for (int i = 0; i < repetitions; ++i) {
+        size_t keystrokes = 0;
+        bench_perf_start();
+        double start = bench_now();
+        for (size_t j = 0; j < NCSH_BENCH_FUZZY_QUERIES; ++j) {
+            const size_t length = strlen(queries[j]);
+            for (size_t k = 1; k <= length; ++k) {
+                char typed_query[NCSH_BENCH_TYPED];
+                memcpy(typed_query, queries[j], k);
+                typed_query[k] = '\0';
+                double keystroke = bench_now();
+                if (edits) {
+                    // a typo is allowed once 4 characters are typed, shorter prefixes are mostly a typo from anything
+                    *found += ncsh_autocompletions_edits(typed_query, k + 1, k > 3 ? 1 : 0, matches,
+                                                         NCSH_MAX_AUTOCOMPLETION_MATCHES, tree, scratch);
+                }
+                else {
+                    *found += ncsh_autocompletions_fuzzy(typed_query, k + 1, matches, NCSH_MAX_AUTOCOMPLETION_MATCHES,
+                                                         tree, scratch);
+                }
+                latencies[keystrokes++] = bench_now() - keystroke;
+            }
+        }
+        double previous = typed.ns;
+        bench_keep(&typed, start, bench_perf_stop(), keystrokes);
+        if (typed.ns != previous) {
+            qsort(latencies, keystrokes, sizeof(double), bench_compare_ns);
+            *p99 = latencies[keystrokes * 99 / 100];
+            *slowest = latencies[keystrokes - 1];
+        }
+    }
+    free(latencies);
+    return typed;
+}
+
+static struct ncsh_Bench_Result bench_search(const struct ncsh_Bench_Corpus* const corpus,
+                                             Autocompletion_Node* const tree,
+                                             const int repetitions,
+                                             size_t* const found)
+{
+    struct ncsh_Bench_Result search = {0};
+    for (int i = 0; i < repetitions; ++i) {
+        bench_perf_start();
+        double start = bench_now();
+        for (size_t j = 0; j < NCSH_BENCH_QUERIES; ++j) {
+            const struct ncsh_String* entry = &corpus->entries[j % corpus->count];
+            *found += ncsh_autocompletions_search(entry->value, entry->length, tree) != NULL;
+        }
+        bench_keep(&search, start, bench_perf_stop(), NCSH_BENCH_QUERIES);
+    }
+    return search;
+}
+
+static void bench_tree(const struct ncsh_Bench_Corpus* const corpus, const int repetitions)
+{
+    Arena arena;
+    Arena scratch;
+    if (!ncsh_arena_create(&arena, 1 << 20) || !ncsh_arena_create(&scratch, 1 << 20)) {
+        fprintf(stderr, "ncsh_bench: could not map the arenas\n");
+        exit(EXIT_FAILURE);
+    }
+
+    struct ncsh_Bench_Result add = {0};
+    Autocompletion_Node* tree = NULL;
+    for (int i = 0; i < repetitions; ++i) {
+        ncsh_arena_reset(&arena);
+        bench_perf_start();
+        double start = bench_now();
+        tree = ncsh_autocompletions_alloc(&arena);
+        ncsh_autocompletions_add_multiple(corpus->entries, corpus->count, tree, &arena);
+        bench_keep(&add, start, bench_perf_stop(), corpus->count);
+    }
+    size_t bytes = ncsh_arena_stats(&arena).high_water;
+    bench_report(corpus, "add_multiple", add, ncsh_autocompletions_count(tree), bytes);
+
+    // exact lookups of entries in corpus order, and prefix queries for get and first
+    size_t found = 0;
+    bench_report(corpus, "search", bench_search(corpus, tree, repetitions, &found), 0, bytes);
+
+    // the same tree built sorted and laid out depth first, and the same lookups on it
+    Arena loaded_arena;
+    if (!ncsh_arena_create(&loaded_arena, 1 << 20)) {
+        fprintf(stderr, "ncsh_bench: could not map the arenas\n");
+        exit(EXIT_FAILURE);
+    }
+    struct ncsh_Bench_Result load = {0};
+    Autocompletion_Node* loaded = NULL;
+    for (int i = 0; i < repetitions; ++i) {
+        ncsh_arena_reset(&loaded_arena);
+        bench_perf_start();
+        double start = bench_now();
+        loaded = ncsh_autocompletions_load(corpus->entries, NULL, (int)corpus->count, &loaded_arena, scratch);
+        bench_keep(&load, start, bench_perf_stop(), corpus->count);
+    }
+    size_t loaded_bytes = ncsh_arena_stats(&loaded_arena).high_water;
+    bench_report(corpus, "load", load, ncsh_autocompletions_count(loaded), loaded_bytes);
+    bench_report(corpus, "load_search", bench_search(corpus, loaded, repetitions, &found), 0, loaded_bytes);
+
+    // the same tree saved and mapped back in, per entry so it compares with add_multiple and load. the file is in the
+    // page cache, so this is a warm start: the header check and the pages the first lookup touches.
+    char path[] = "/tmp/ncsh_bench_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        fprintf(stderr, "ncsh_bench: could not make a temporary file: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+    if (!ncsh_autocompletions_save(path, loaded, scratch)) {
+        fprintf(stderr, "ncsh_bench: could not save the tree to %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    struct ncsh_Bench_Result map = {0};
+    struct ncsh_Bench_Result verify = {0};
+    struct ncsh_Autocompletions_Mapping mapping = {0};
+    size_t mapped_bytes = 0;
+    for (int i = 0; i < repetitions; ++i) {
+        ncsh_arena_reset(&loaded_arena);
+        bench_perf_start();
+        double start = bench_now();
+        Autocompletion_Node* mapped = ncsh_autocompletions_map(path, &mapping, &loaded_arena);
+        found += mapped && ncsh_autocompletions_search(corpus->entries[0].value, corpus->entries[0].length, mapped);
+        bench_keep(&map, start, bench_perf_stop(), corpus->count);
+
+        // what a caller pays to check the whole image against its checksum as well
+        bench_perf_start();
+        start = bench_now();
+        found += mapped && ncsh_autocompletions_verify(&mapping);
+        bench_keep(&verify, start, bench_perf_stop(), corpus->count);
+        mapped_bytes = mapping.size;
+        ncsh_autocompletions_unmap(&mapping);
+    }
+    unlink(path);
+    bench_report(corpus, "map", map, 0, mapped_bytes);
+    bench_report(corpus, "map_verify", verify, 0, mapped_bytes);
+    ncsh_arena_destroy(&loaded_arena);
+
+    struct ncsh_String* queries = malloc(NCSH_BENCH_QUERIES * sizeof(struct ncsh_String));
+    if (!queries) {
+        exit(EXIT_FAILURE);
+    }
+    bench_queries(corpus, queries);
+
+    // get and get_packed take turns in each repetition so drift in the machine's speed hits both alike, and each has
+    // its own scratch arena: their bytes are the most scratch one call used, values included for get. the walk is
+    // the same, packing only saves the copies of the shared prefixes, a few hundred bytes a call.
+    Arena get_scratch;
+    Arena packed_scratch;
+    if (!ncsh_arena_create(&get_scratch, 1 << 20) || !ncsh_arena_create(&packed_scratch, 1 << 20)) {
+        fprintf(stderr, "ncsh_bench: could not map the arenas\n");
+        exit(EXIT_FAILURE);
+    }
+    struct ncsh_Bench_Result get = {0};
+    struct ncsh_Bench_Result get_packed = {0};
+    Autocompletion matches[NCSH_MAX_AUTOCOMPLETION_MATCHES];
+    Autocompletion_Span spans[NCSH_MAX_AUTOCOMPLETION_MATCHES];
+    static char buffer[NCSH_MAX_AUTOCOMPLETION_MATCHES * MAX_INPUT];
+    char query[MAX_INPUT];
+    for (int i = 0; i < repetitions; ++i) {
+        bench_perf_start();
+        double start = bench_now();
+        for (size_t j = 0; j < NCSH_BENCH_QUERIES; ++j) {
+            memcpy(query, queries[j].value, queries[j].length - 1);
+            query[queries[j].length - 1] = '\0';
+            found += ncsh_autocompletions_get(query, queries[j].length, matches, NCSH_MAX_AUTOCOMPLETION_MATCHES, tree,
+                                              get_scratch);
+        }
+        bench_keep(&get, start, bench_perf_stop(), NCSH_BENCH_QUERIES);
+
+        bench_perf_start();
+        start = bench_now();
+        for (size_t j = 0; j < NCSH_BENCH_QUERIES; ++j) {
+            memcpy(query, queries[j].value, queries[j].length - 1);
+            query[queries[j].length - 1] = '\0';
+            found += ncsh_autocompletions_get_packed(query, queries[j].length, spans, NCSH_MAX_AUTOCOMPLETION_MATCHES,
+                                                     buffer, sizeof(buffer), tree, packed_scratch);
+        }
+        bench_keep(&get_packed, start, bench_perf_stop(), NCSH_BENCH_QUERIES);
+    }
+    bench_report(corpus, "get", get, 0, ncsh_arena_stats(&get_scratch).high_water);
+    bench_report(corpus, "get_packed", get_packed, 0, ncsh_arena_stats(&packed_scratch).high_water);
+    ncsh_arena_destroy(&packed_scratch);
+    ncsh_arena_destroy(&get_scratch);
+
+    struct ncsh_Bench_Result first = {0};
+    char match[MAX_INPUT];
+    for (int i = 0; i < repetitions; ++i) {
+        bench_perf_start();
+        double start = bench_now();
+        for (size_t j = 0; j < NCSH_BENCH_QUERIES; ++j) {
+            memcpy(query, queries[j].value, queries[j].length - 1);
+            query[queries[j].length - 1] = '\0';
+            found += ncsh_autocompletions_first(query, queries[j].length, match, tree);
+        }
+        bench_keep(&first, start, bench_perf_stop(), NCSH_BENCH_QUERIES);
+    }
+    bench_report(corpus, "first", first, 0, bytes);
+
+    char (*typed_queries)[NCSH_BENCH_TYPED] = malloc(NCSH_BENCH_FUZZY_QUERIES * sizeof(*typed_queries));
+    if (!typed_queries) {
+        exit(EXIT_FAILURE);
+    }
+    struct ncsh_Bench_Result p99 = {.misses = -1};
+    struct ncsh_Bench_Result slowest = {.misses = -1};
+    bench_fuzzy_queries(corpus, typed_queries);
+    bench_report(corpus, "fuzzy",
+                 bench_keystrokes(typed_queries, false, tree, scratch, repetitions, &p99.ns, &slowest.ns, &found), 0,
+                 bytes);
+    bench_report(corpus, "fuzzy_p99", p99, 0, bytes);
+    bench_report(corpus, "fuzzy_slowest", slowest, 0, bytes);
+
+    bench_edits_queries(corpus, typed_queries);
+    bench_report(corpus, "edits",
+                 bench_keystrokes(typed_queries, true, tree, scratch, repetitions, &p99.ns, &slowest.ns, &found), 0,
+                 bytes);
+    bench_report(corpus, "edits_p99", p99, 0, bytes);
+    bench_report(corpus, "edits_slowest", slowest, 0, bytes);
+    free(typed_queries);
+
+    // keeps the lookups from being optimized away
+    if (!found) {
+        fprintf(stderr, "ncsh_bench: no entries found in %s\n", corpus->name);
+    }
+
+    free(queries);
+    ncsh_arena_destroy(&scratch);
+    ncsh_arena_destroy(&arena);
+}
+
+// buffers filled a byte at a time, doubling when full like the child arrays of compact nodes, grown either by
+// arena_realloc while they are the last allocation, or by bumping a new block and copying into it. reported per byte
+// appended, with the bytes the buffers took from the arena.
+static void bench_buffer(const char* const name,
+                         const int repetitions,
+                         const bool in_place,
+                         uintptr_t* const sum)
+{
+    Arena arena;
+    if (!ncsh_arena_create(&arena, 1 << 20)) {
+        fprintf(stderr, "ncsh_bench: could not map the arena\n");
+        exit(EXIT_FAILURE);
+    }
+
+    const size_t buffers = NCSH_BENCH_ALLOCATIONS / NCSH_BENCH_BUFFER_BYTES;
+    struct ncsh_Bench_Result grow = {0};
+    for (int i = 0; i < repetitions; ++i) {
+        ncsh_arena_reset(&arena);
+        bench_perf_start();
+        double start = bench_now();
+        for (size_t j = 0; j < buffers; ++j) {
+            size_t capacity = 16;
+            char* buffer = arena_malloc_uninitialized(&arena, capacity, char);
+            for (size_t k = 0; k < NCSH_BENCH_BUFFER_BYTES; ++k) {
+                if (k == capacity) {
+                    if (in_place) {
+                        buffer = arena_realloc(&arena, capacity * 2, char, buffer, capacity);
+                    }
+                    else {
+                        char* grown = arena_malloc_uninitialized(&arena, capacity * 2, char);
+                        memcpy(grown, buffer, capacity);
+                        buffer = grown;
+                    }
+                    capacity *= 2;
+                }
+                buffer[k] = (char)k;
+            }
+            *sum += (uintptr_t)buffer[j % NCSH_BENCH_BUFFER_BYTES];
+        }
+        bench_keep(&grow, start, bench_perf_stop(), buffers * NCSH_BENCH_BUFFER_BYTES);
+    }
+
+    struct ncsh_Bench_Corpus corpus = {.name = "-", .count = buffers * NCSH_BENCH_BUFFER_BYTES};
+    bench_report(&corpus, name, grow, 0, ncsh_arena_stats(&arena).high_water);
+    ncsh_arena_destroy(&arena);
+}
+
+// small allocations of the sizes and alignments the tree makes, from a chunked arena that grows as it goes.
+static void bench_arena(const int repetitions)
+{
+    Arena arena;
+    if (!ncsh_arena_create(&arena, 1 << 20)) {
+        fprintf(stderr, "ncsh_bench: could not map the arena\n");
+        exit(EXIT_FAILURE);
+    }
+
+    static const uintptr_t sizes[] = {1, 8, 16, 48, 3, 24};
+    struct ncsh_Bench_Result malloc_internal = {0};
+    uintptr_t sum = 0;
+    for (int i = 0; i < repetitions; ++i) {
+        ncsh_arena_reset(&arena);
+        bench_perf_start();
+        double start = bench_now();
+        for (size_t j = 0; j < NCSH_BENCH_ALLOCATIONS; ++j) {
+            uintptr_t size = sizes[j % BENCH_COUNT(sizes)];
+            sum += (uintptr_t)ncsh_arena_malloc_internal(&arena, 1, size, size >= 8 ? 8 : 1);
+        }
+        bench_keep(&malloc_internal, start, bench_perf_stop(), NCSH_BENCH_ALLOCATIONS);
+    }
+
+    struct ncsh_Bench_Corpus corpus = {.name = "-", .count = NCSH_BENCH_ALLOCATIONS};
+    bench_report(&corpus, "arena_malloc", malloc_internal, 0, ncsh_arena_stats(&arena).high_water);
+
+    bench_buffer("realloc_tip", repetitions, true, &sum);
+    bench_buffer("bump_copy", repetitions, false, &sum);
+    if (!sum) {
+        fprintf(stderr, "ncsh_bench: no allocations\n");
+    }
+    ncsh_arena_destroy(&arena);
+}
+
+int main(int argc, char** argv)
+{
+    size_t max_entries = NCSH_BENCH_MAX_ENTRIES;
+    int repetitions = 5;
+    const char* history_file = NULL;
+    bench_seed = 0x6e637368; // "ncsh"
+
+    int option;
+    while ((option = getopt(argc, argv, "n:r:s:f:")) != -1) {
+        switch (option) {
+        case 'n':
+            max_entries = strtoul(optarg, NULL, 10);
+            break;
+        case 'r':
+            repetitions = atoi(optarg);
+            break;
+        case 's':
+            bench_seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'f':
+            history_file = optarg;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n max_entries] [-r repetitions] [-s seed] [-f history_file]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (repetitions < 1 || !bench_seed) {
+        fprintf(stderr, "ncsh_bench: repetitions and seed must be positive\n");
+        return EXIT_FAILURE;
+    }
+
+    bench_perf_open();
+    printf("%-12s %-8s %8s %-14s %10s %10s %12s %10s\n", "layout", "corpus", "entries", "benchmark", "ns/op", "nodes",
+           "bytes", "misses/op");
+
+    for (size_t count = 1000; count <= max_entries; count *= 10) {
+        struct ncsh_Bench_Corpus corpus;
+        if (!bench_corpus_synthetic(&corpus, count)) {
+            fprintf(stderr, "ncsh_bench: could not make a corpus of %zu entries\n", count);
+            return EXIT_FAILURE;
+        }
+        bench_tree(&corpus, repetitions);
+        bench_corpus_free(&corpus);
+    }
+
+    if (history_file) {
+        struct ncsh_Bench_Corpus corpus;
+        if (!bench_corpus_file(&corpus, history_file)) {
+            fprintf(stderr, "ncsh_bench: could not read entries from %s: %s\n", history_file, strerror(errno));
+            return EXIT_FAILURE;
+        }
+        bench_tree(&corpus, repetitions);
+        bench_corpus_free(&corpus);
+    }
+
+    bench_arena(repetitions);
+
+    if (perf_fd >= 0) {
+        close(perf_fd);
+    }
+    return EXIT_SUCCESS;
+}
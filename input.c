@@ -101,6 +101,12 @@ rl_getc_func_t *rl_getc_function = rl_getc;
 
 static int _keyboard_input_timeout = 100000;		/* 0.1 seconds; it's in usec */
 
+/* Non-zero while a redisplay has been put off because more input was
+   waiting; rl_redisplay clears it.  REDISPLAY_DEFERRED_AT is when the
+   first key since the last redisplay was left undrawn. */
+int _rl_redisplay_deferred = 0;
+static struct timeval redisplay_deferred_at;
+
 static int ibuffer_space (void);
 static int rl_get_char (int *);
 static int rl_gather_tyi (void);
@@ -441,6 +447,36 @@ _rl_input_queued (int t)
   return r;
 }
 
+/* Return non-zero if the redisplay after the key just dispatched can wait
+   because more input is already queued, as long as the screen hasn't gone
+   without an update for _rl_redisplay_max_delay milliseconds.  A paste or
+   a repeating key that outruns the terminal is then drawn once when the
+   input runs out, and every _rl_redisplay_max_delay milliseconds while it
+   keeps coming. */
+int
+_rl_defer_redisplay (void)
+{
+  struct timeval now;
+  long elapsed;
+
+  if (_rl_redisplay_max_delay <= 0)
+    return 0;
+  if (_rl_pushed_input_available () == 0 && _rl_input_queued (0) == 0)
+    return 0;
+  if (gettimeofday (&now, 0) != 0)
+    return 0;
+
+  if (_rl_redisplay_deferred == 0)
+    {
+      redisplay_deferred_at = now;
+      _rl_redisplay_deferred = 1;
+      return 1;
+    }
+  elapsed = (now.tv_sec - redisplay_deferred_at.tv_sec) * 1000 +
+	    (now.tv_usec - redisplay_deferred_at.tv_usec) / 1000;
+  return (elapsed < _rl_redisplay_max_delay);
+}
+
 void
 _rl_insert_typein (int c)
 {
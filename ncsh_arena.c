@@ -25,6 +25,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 
 #if defined (READLINE_LIBRARY)
 #  include "ncsh_arena.h"
@@ -32,25 +33,179 @@
 #  include <readline/ncsh_arena.h>
 #endif
 
+struct ncsh_Arena_Chunk {
+    struct ncsh_Arena_Chunk* first;
+    struct ncsh_Arena_Chunk* previous;
+    struct ncsh_Arena_Chunk* next;
+    size_t size;   // bytes mapped for the chunk, including this header
+    size_t offset; // bytes of usable space in the chunks before this one
+    struct ncsh_Arena_Stats stats; // only kept up to date in the first chunk
+};
+
+#define NCSH_ARENA_MINIMUM_CHUNK 4096
+
+static inline char* ncsh_arena_chunk_begin(struct ncsh_Arena_Chunk* chunk)
+{
+    return (char*)(chunk + 1);
+}
+
+static inline char* ncsh_arena_chunk_end(struct ncsh_Arena_Chunk* chunk)
+{
+    return (char*)chunk + chunk->size;
+}
+
+static struct ncsh_Arena_Chunk* ncsh_arena_chunk_map(size_t size)
+{
+    if (size < NCSH_ARENA_MINIMUM_CHUNK) {
+        size = NCSH_ARENA_MINIMUM_CHUNK;
+    }
+    void* memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        return NULL;
+    }
+    struct ncsh_Arena_Chunk* chunk = memory;
+    *chunk = (struct ncsh_Arena_Chunk){.size = size};
+    return chunk;
+}
+
+bool ncsh_arena_create(struct ncsh_Arena* arena,
+                       size_t size)
+{
+    assert(arena);
+    struct ncsh_Arena_Chunk* chunk = ncsh_arena_chunk_map(size);
+    if (!chunk) {
+        return false;
+    }
+    chunk->first = chunk;
+    chunk->stats.chunks = 1;
+    chunk->stats.reserved = chunk->size;
+    *arena = (struct ncsh_Arena){.start = ncsh_arena_chunk_begin(chunk), .end = ncsh_arena_chunk_end(chunk), .chunk = chunk};
+    return true;
+}
+
+void ncsh_arena_destroy(struct ncsh_Arena* arena)
+{
+    if (!arena || !arena->chunk) {
+        return;
+    }
+    struct ncsh_Arena_Chunk* chunk = arena->chunk->first;
+    while (chunk) {
+        struct ncsh_Arena_Chunk* next = chunk->next;
+        munmap(chunk, chunk->size);
+        chunk = next;
+    }
+    *arena = (struct ncsh_Arena){0};
+}
+
+void ncsh_arena_reset(struct ncsh_Arena* arena)
+{
+    assert(arena);
+    if (!arena->chunk) {
+        return;
+    }
+    struct ncsh_Arena_Chunk* first = arena->chunk->first;
+    *arena = (struct ncsh_Arena){.start = ncsh_arena_chunk_begin(first), .end = ncsh_arena_chunk_end(first), .chunk = first};
+}
+
+struct ncsh_Arena_Stats ncsh_arena_stats(const struct ncsh_Arena* arena)
+{
+    if (!arena || !arena->chunk) {
+        return (struct ncsh_Arena_Stats){0};
+    }
+    return arena->chunk->first->stats;
+}
+
+// moves the arena to the chunk after its current one, mapping a new chunk if that one can't fit the allocation.
+static bool ncsh_arena_grow(struct ncsh_Arena* arena,
+                            uintptr_t count,
+                            uintptr_t size,
+                            uintptr_t alignment)
+{
+    struct ncsh_Arena_Chunk* chunk = arena->chunk;
+    if (count > (SIZE_MAX - sizeof(struct ncsh_Arena_Chunk) - alignment) / size) {
+        return false;
+    }
+    size_t needed = sizeof(struct ncsh_Arena_Chunk) + alignment + count * size;
+
+    struct ncsh_Arena_Chunk* next = chunk->next;
+    if (!next || next->size < needed) {
+        size_t grown = chunk->size * 2 > needed ? chunk->size * 2 : needed;
+        struct ncsh_Arena_Chunk* inserted = ncsh_arena_chunk_map(grown);
+        if (!inserted) {
+            return false;
+        }
+        inserted->first = chunk->first;
+        inserted->previous = chunk;
+        inserted->next = next;
+        if (next) {
+            next->previous = inserted;
+        }
+        chunk->next = inserted;
+        chunk->first->stats.chunks++;
+        chunk->first->stats.reserved += inserted->size;
+        next = inserted;
+    }
+
+    next->offset = chunk->offset + (size_t)(ncsh_arena_chunk_end(chunk) - ncsh_arena_chunk_begin(chunk));
+    arena->chunk = next;
+    arena->start = ncsh_arena_chunk_begin(next);
+    arena->end = ncsh_arena_chunk_end(next);
+    return true;
+}
+
+static inline void ncsh_arena_track(struct ncsh_Arena* arena)
+{
+    if (!arena->chunk) {
+        return;
+    }
+    struct ncsh_Arena_Stats* stats = &arena->chunk->first->stats;
+    size_t used = arena->chunk->offset + (size_t)(arena->start - ncsh_arena_chunk_begin(arena->chunk));
+    if (used > stats->high_water) {
+        stats->high_water = used;
+    }
+}
+
+// bumps the arena past count elements of size, growing chunked arenas. the memory is not zeroed.
+static void* ncsh_arena_bump(struct ncsh_Arena* arena,
+                             uintptr_t count,
+                             uintptr_t size,
+                             uintptr_t alignment)
+{
+    uintptr_t padding = -(uintptr_t)arena->start & (alignment - 1);
+    uintptr_t available = (uintptr_t)arena->end - (uintptr_t)arena->start;
+    if (padding > available || count > (available - padding) / size) {
+        if (!arena->chunk || !ncsh_arena_grow(arena, count, size, alignment)) {
+            puts("ncsh: ran out of allocated memory.");
+            abort();
+        }
+        padding = -(uintptr_t)arena->start & (alignment - 1);
+    }
+
+    void* val = arena->start + padding;
+    arena->start += padding + count * size;
+    ncsh_arena_track(arena);
+    return val;
+}
+
 __attribute_malloc__
 void* ncsh_arena_malloc_internal(struct ncsh_Arena* arena,
                      uintptr_t count,
                      uintptr_t size,
                      uintptr_t alignment)
 {
-    uintptr_t padding = -(uintptr_t)arena->start & (alignment - 1);
-    uintptr_t available = (uintptr_t)arena->end - (uintptr_t)arena->start - padding;
-    assert(count < available / size);
-    if (available == 0 || count > available / size) {
-        puts("ncsh: ran out of allocated memory.");
-        abort();
-    }
-    void* val = arena->start + padding;
-    arena->start += padding + count * size;
+    void* val = ncsh_arena_bump(arena, count, size, alignment);
     return memset(val, 0, count * size);
 }
 
 __attribute_malloc__
+void* ncsh_arena_malloc_uninitialized_internal(struct ncsh_Arena* arena,
+                     uintptr_t count,
+                     uintptr_t size,
+                     uintptr_t alignment)
+{
+    return ncsh_arena_bump(arena, count, size, alignment);
+}
+
 void* ncsh_arena_realloc_internal(struct ncsh_Arena* arena,
                      uintptr_t count,
                      uintptr_t size,
@@ -58,16 +213,29 @@ void* ncsh_arena_realloc_internal(struct ncsh_Arena* arena,
                      void* old_ptr,
                      uintptr_t old_count)
 {
-    uintptr_t padding = -(uintptr_t)arena->start & (alignment - 1);
-    uintptr_t available = (uintptr_t)arena->end - (uintptr_t)arena->start - padding;
-    assert(count < available / size);
-    if (available == 0 || count > available / size) {
-        puts("ncsh: ran out of allocated memory.");
-        abort();
-    }
-    void* val = arena->start + padding;
-    arena->start += padding + count * size;
-    memset(val, 0, count * size);
     assert(old_ptr);
-    return memcpy(val, old_ptr, old_count * size);
+
+    // the last allocation is resized in place, only the grown part needs zeroing
+    char* old_end = (char*)old_ptr + old_count * size;
+    if (old_end == arena->start) {
+        if (count <= old_count) {
+            arena->start = (char*)old_ptr + count * size;
+            return old_ptr;
+        }
+        uintptr_t available = (uintptr_t)arena->end - (uintptr_t)arena->start;
+        if (count - old_count <= available / size) {
+            arena->start += (count - old_count) * size;
+            ncsh_arena_track(arena);
+            memset(old_end, 0, (count - old_count) * size);
+            return old_ptr;
+        }
+    }
+    else if (count <= old_count) {
+        return old_ptr;
+    }
+
+    char* val = ncsh_arena_bump(arena, count, size, alignment);
+    memcpy(val, old_ptr, old_count * size);
+    memset(val + old_count * size, 0, (count - old_count) * size);
+    return val;
 }
@@ -19,17 +19,49 @@
 #ifndef NCSH_ARENA_H_
 #define NCSH_ARENA_H_
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <sys/cdefs.h>
 
+struct ncsh_Arena_Chunk;
+
+/* An arena is either fixed, a start..end block provided by the caller that aborts when it is exhausted,
+ * or chunked, created by ncsh_arena_create, which maps a new chunk when the current one is exhausted.
+ * Chunks are kept after the arena is rewound or a by value copy of it goes out of scope, and are reused
+ * by the next allocation that runs past the end of the chunk before them.
+ */
 struct ncsh_Arena {
     char* start;
     char* end;
+    struct ncsh_Arena_Chunk* chunk; // NULL for fixed arenas
 };
 
 /* I don't use typedefs in most of my projects, but use here to keep consistent with readline style */
 typedef struct ncsh_Arena Arena;
 
+struct ncsh_Arena_Stats {
+    size_t chunks;     // chunks currently mapped
+    size_t reserved;   // bytes mapped for all chunks
+    size_t high_water; // most bytes in use at once, including the unused ends of chunks that were grown past
+};
+
+// returns false if the first chunk of size bytes could not be mapped.
+bool ncsh_arena_create(struct ncsh_Arena* arena, size_t size);
+
+// unmaps every chunk of an arena made by ncsh_arena_create.
+void ncsh_arena_destroy(struct ncsh_Arena* arena);
+
+// frees everything allocated from a chunked arena in O(1), keeping its chunks mapped for reuse.
+void ncsh_arena_reset(struct ncsh_Arena* arena);
+
+// the stats are zero for fixed arenas.
+struct ncsh_Arena_Stats ncsh_arena_stats(const struct ncsh_Arena* arena);
+
+// a mark is a copy of the arena, rewinding to it frees everything allocated after the mark was taken in O(1).
+#define arena_mark(arena) (*(arena))
+#define arena_rewind(arena, mark) (*(arena) = (mark))
+
 #define arena_malloc(arena, count, type) \
     (type*)ncsh_arena_malloc_internal(arena, count, sizeof(type), _Alignof(type))
 
@@ -38,14 +70,25 @@ void* ncsh_arena_malloc_internal(struct ncsh_Arena* arena,
                      uintptr_t size,
                      uintptr_t alignment) __attribute_malloc__;
 
+// like arena_malloc, but the memory is not zeroed. for allocations the caller fully overwrites.
+#define arena_malloc_uninitialized(arena, count, type) \
+    (type*)ncsh_arena_malloc_uninitialized_internal(arena, count, sizeof(type), _Alignof(type))
+
+void* ncsh_arena_malloc_uninitialized_internal(struct ncsh_Arena* arena,
+                     uintptr_t count,
+                     uintptr_t size,
+                     uintptr_t alignment) __attribute_malloc__;
+
+// grows or shrinks in place when ptr is the last allocation, otherwise copies it to a new block.
+// elements past old_count are zeroed.
 #define arena_realloc(arena, count, type, ptr, old_count) \
-    (type*)ncsh_arena_realloc_internal(arena, count, sizeof(type), _Alignof(type), ptr, old_count);
+    (type*)ncsh_arena_realloc_internal(arena, count, sizeof(type), _Alignof(type), ptr, old_count)
 
 void* ncsh_arena_realloc_internal(struct ncsh_Arena* arena,
                      uintptr_t count,
                      uintptr_t size,
                      uintptr_t alignment,
                      void* old_ptr,
-                     uintptr_t old_count) __attribute_malloc__;
+                     uintptr_t old_count);
 
 #endif /* !NCSH_ARENA_H_ */
@@ -18,6 +18,8 @@
    along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
 
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <linux/limits.h>
 #include <stdbool.h>
 #include <stddef.h>
@@ -25,6 +27,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdatomic.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "ncsh_string.h"
 #include "ncsh_autocompletions.h"
@@ -32,6 +40,390 @@
 int ncsh_char_to_index(char character);
 char ncsh_index_to_char(int index);
 
+/* Child node access. Everything below goes through these so the same traversal code works for either layout.
+   Links are byte offsets from the node holding them, 0 for none (a node never links to itself).
+   Links out of a node read from a file (its span isn't 0) are checked when they are followed. Images are written depth
+   first, so everything a node links to lies after it and inside its span, and each child's span inside its parent's.
+   A link that doesn't reads as no child, and paths through the image get shorter at every step. A forged image can link
+   nodes that overlap, so a write through one can change whether a link out of another checks out; removing a child
+   that no longer does is a no-op. */
+static inline struct ncsh_Autocompletion_Node* ncsh_autocompletions_at(const struct ncsh_Autocompletion_Node* const node,
+                                                                       const ptrdiff_t offset)
+{
+    return (struct ncsh_Autocompletion_Node*)((char*)node + offset);
+}
+
+static inline ptrdiff_t ncsh_autocompletions_offset(const struct ncsh_Autocompletion_Node* const node,
+                                                    const void* const target)
+{
+    return (const char*)target - (const char*)node;
+}
+
+// true if size bytes at offset from a node read from a file lie after the node and inside its span.
+static inline bool ncsh_autocompletions_in_span(const struct ncsh_Autocompletion_Node* const node,
+                                                const ptrdiff_t offset,
+                                                const size_t size)
+{
+    return offset >= (ptrdiff_t)sizeof(*node) && !(offset % (ptrdiff_t)_Alignof(struct ncsh_Autocompletion_Node)) &&
+           (size_t)offset <= node->span && size <= node->span - (size_t)offset;
+}
+
+// true if the node at the start of an image has a span inside the image and a valid bool: read as a byte, any other
+// value than 0 or 1 isn't one.
+static inline bool ncsh_autocompletions_node_valid(const struct ncsh_Autocompletion_Node* const node,
+                                                   const size_t size)
+{
+    uint8_t end_of_a_word;
+    memcpy(&end_of_a_word, &node->is_end_of_a_word, sizeof(end_of_a_word));
+    return end_of_a_word <= 1 && node->span >= sizeof(*node) && node->span <= size;
+}
+
+// true if the child at offset from a node read from a file lies inside its span, and so does the child's own span.
+static inline bool ncsh_autocompletions_child_in_span(const struct ncsh_Autocompletion_Node* const node,
+                                                      const ptrdiff_t offset)
+{
+    return ncsh_autocompletions_in_span(node, offset, sizeof(*node)) &&
+           ncsh_autocompletions_node_valid(ncsh_autocompletions_at(node, offset), node->span - (size_t)offset);
+}
+
+#ifndef NCSH_AUTOCOMPLETIONS_COMPACT
+// the block of child links holding index, NULL if no child in it was ever added.
+static inline ptrdiff_t* ncsh_autocompletions_block(const struct ncsh_Autocompletion_Node* const node,
+                                                    const int index)
+{
+    const ptrdiff_t block = node->nodes[index / NCSH_DENSE_BLOCK];
+    if (!block || (node->span && !ncsh_autocompletions_in_span(node, block, NCSH_DENSE_BLOCK * sizeof(ptrdiff_t)))) {
+        return NULL;
+    }
+    return (ptrdiff_t*)((char*)node + block);
+}
+
+static inline struct ncsh_Autocompletion_Node* ncsh_autocompletions_child(const struct ncsh_Autocompletion_Node* const node,
+                                                                          const int index)
+{
+    const ptrdiff_t* const block = ncsh_autocompletions_block(node, index);
+    if (!block || !block[index % NCSH_DENSE_BLOCK] ||
+        (node->span && (!index || !ncsh_autocompletions_child_in_span(node, block[index % NCSH_DENSE_BLOCK])))) {
+        return NULL;
+    }
+    return ncsh_autocompletions_at(node, block[index % NCSH_DENSE_BLOCK]);
+}
+
+static inline int ncsh_autocompletions_next_index(const struct ncsh_Autocompletion_Node* const node,
+                                                  int index)
+{
+    while (index < NCSH_LETTERS) {
+        const ptrdiff_t* const block = ncsh_autocompletions_block(node, index);
+        if (!block) {
+            index = (index / NCSH_DENSE_BLOCK + 1) * NCSH_DENSE_BLOCK;
+            continue;
+        }
+        if (block[index % NCSH_DENSE_BLOCK]) {
+            return index;
+        }
+        ++index;
+    }
+    return NCSH_LETTERS;
+}
+
+static void ncsh_autocompletions_own(struct ncsh_Autocompletion_Node* const node);
+
+static inline struct ncsh_Autocompletion_Node* ncsh_autocompletions_child_add(struct ncsh_Autocompletion_Node* const node,
+                                                                              const int index,
+                                                                              struct ncsh_Arena* const arena)
+{
+    ncsh_autocompletions_own(node);
+    ptrdiff_t* block = ncsh_autocompletions_block(node, index);
+    if (!block) {
+        block = arena_malloc(arena, NCSH_DENSE_BLOCK, ptrdiff_t);
+        node->nodes[index / NCSH_DENSE_BLOCK] = ncsh_autocompletions_offset(node, block);
+    }
+    struct ncsh_Autocompletion_Node* const child = arena_malloc(arena, 1, struct ncsh_Autocompletion_Node);
+    block[index % NCSH_DENSE_BLOCK] = ncsh_autocompletions_offset(node, child);
+    return child;
+}
+
+// unlinks the child, its nodes stay in the arena. the block stays for later adds.
+static inline void ncsh_autocompletions_child_remove(struct ncsh_Autocompletion_Node* const node,
+                                                     const int index)
+{
+    ncsh_autocompletions_own(node);
+    ptrdiff_t* const block = ncsh_autocompletions_block(node, index);
+    if (block) {
+        block[index % NCSH_DENSE_BLOCK] = 0;
+    }
+}
+#else
+// the node's array of child links, ordered by index.
+static inline ptrdiff_t* ncsh_autocompletions_children(const struct ncsh_Autocompletion_Node* const node)
+{
+    return (ptrdiff_t*)((char*)node + node->nodes);
+}
+
+static inline bool ncsh_autocompletions_has_child(const struct ncsh_Autocompletion_Node* const node,
+                                                  const int index)
+{
+    return node->bitmap[index / 64] & (1ULL << (index % 64));
+}
+
+// position of the child for index in the nodes array: number of children with a lower index.
+static inline int ncsh_autocompletions_rank(const struct ncsh_Autocompletion_Node* const node,
+                                            const int index)
+{
+    int rank = 0;
+    for (int i = 0; i < index / 64; ++i) {
+        rank += __builtin_popcountll(node->bitmap[i]);
+    }
+    return rank + __builtin_popcountll(node->bitmap[index / 64] & ((1ULL << (index % 64)) - 1));
+}
+
+static inline struct ncsh_Autocompletion_Node* ncsh_autocompletions_child(const struct ncsh_Autocompletion_Node* const node,
+                                                                          const int index)
+{
+    if (!ncsh_autocompletions_has_child(node, index)) {
+        return NULL;
+    }
+    const int rank = ncsh_autocompletions_rank(node, index);
+    if (node->span && (!index || rank >= node->nodes_count ||
+                       !ncsh_autocompletions_in_span(node, node->nodes, node->nodes_count * sizeof(ptrdiff_t)) ||
+                       !ncsh_autocompletions_child_in_span(node, ncsh_autocompletions_children(node)[rank]))) {
+        return NULL;
+    }
+    return ncsh_autocompletions_at(node, ncsh_autocompletions_children(node)[rank]);
+}
+
+static inline int ncsh_autocompletions_next_index(const struct ncsh_Autocompletion_Node* const node,
+                                                  const int index)
+{
+    for (int word = index / 64; word < NCSH_BITMAP_WORDS; ++word) {
+        uint64_t bits = node->bitmap[word];
+        if (word == index / 64) {
+            bits &= ~0ULL << (index % 64);
+        }
+        if (bits) {
+            int next = word * 64 + __builtin_ctzll(bits);
+            return next < NCSH_LETTERS ? next : NCSH_LETTERS;
+        }
+    }
+    return NCSH_LETTERS;
+}
+
+static void ncsh_autocompletions_own(struct ncsh_Autocompletion_Node* const node);
+
+static inline struct ncsh_Autocompletion_Node* ncsh_autocompletions_child_add(struct ncsh_Autocompletion_Node* const node,
+                                                                              const int index,
+                                                                              struct ncsh_Arena* const arena)
+{
+    ncsh_autocompletions_own(node);
+    if (node->nodes_count == node->nodes_capacity) {
+        int capacity = node->nodes_capacity ? node->nodes_capacity * 2 : 1;
+        if (capacity > NCSH_LETTERS - 1) {
+            capacity = NCSH_LETTERS - 1;
+        }
+        ptrdiff_t* children;
+        if (!node->nodes) {
+            children = arena_malloc(arena, capacity, ptrdiff_t);
+        }
+        else {
+            children = arena_realloc(arena, capacity, ptrdiff_t, ncsh_autocompletions_children(node), node->nodes_count);
+        }
+        node->nodes = ncsh_autocompletions_offset(node, children);
+        node->nodes_capacity = (uint8_t)capacity;
+    }
+
+    // links are relative to the node, not to their slot, so shifting them along the array keeps them valid
+    ptrdiff_t* const children = ncsh_autocompletions_children(node);
+    int rank = ncsh_autocompletions_rank(node, index);
+    memmove(children + rank + 1, children + rank, (node->nodes_count - rank) * sizeof(*children));
+    struct ncsh_Autocompletion_Node* const child = arena_malloc(arena, 1, struct ncsh_Autocompletion_Node);
+    children[rank] = ncsh_autocompletions_offset(node, child);
+    node->bitmap[index / 64] |= 1ULL << (index % 64);
+    ++node->nodes_count;
+    return child;
+}
+
+// unlinks the child, its nodes stay in the arena. the array keeps its capacity for later adds.
+static inline void ncsh_autocompletions_child_remove(struct ncsh_Autocompletion_Node* const node,
+                                                     const int index)
+{
+    ncsh_autocompletions_own(node);
+    if (!ncsh_autocompletions_has_child(node, index)) {
+        return;
+    }
+    ptrdiff_t* const children = ncsh_autocompletions_children(node);
+    int rank = ncsh_autocompletions_rank(node, index);
+    memmove(children + rank, children + rank + 1, (node->nodes_count - rank - 1) * sizeof(*children));
+    node->bitmap[index / 64] &= ~(1ULL << (index % 64));
+    --node->nodes_count;
+}
+#endif // !NCSH_AUTOCOMPLETIONS_COMPACT
+
+// returns the first index >= index which has a child, or NCSH_LETTERS if there are none.
+// children of a node read from a file whose links don't check out are skipped.
+static inline int ncsh_autocompletions_next(const struct ncsh_Autocompletion_Node* const node,
+                                            int index)
+{
+    index = ncsh_autocompletions_next_index(node, index);
+    while (node->span && index < NCSH_LETTERS && !ncsh_autocompletions_child(node, index)) {
+        index = ncsh_autocompletions_next_index(node, index + 1);
+    }
+    return index;
+}
+
+// drops the links of a node read from a file that don't check out and marks it as built in memory, before its links
+// are changed: the links added to it point outside of its span. its children keep theirs. a node read from a file
+// only accepts children read from it too, so paths are owned from the root down before anything on them changes.
+static void ncsh_autocompletions_own(struct ncsh_Autocompletion_Node* const node)
+{
+    if (!node->span) {
+        return;
+    }
+
+#ifndef NCSH_AUTOCOMPLETIONS_COMPACT
+    for (int i = 0; i < NCSH_DENSE_BLOCKS; ++i) {
+        ptrdiff_t* const block = ncsh_autocompletions_block(node, i * NCSH_DENSE_BLOCK);
+        if (!block) {
+            node->nodes[i] = 0;
+            continue;
+        }
+        for (int j = 0; j < NCSH_DENSE_BLOCK; ++j) {
+            if (block[j] && !ncsh_autocompletions_child(node, i * NCSH_DENSE_BLOCK + j)) {
+                block[j] = 0;
+            }
+        }
+    }
+#else
+    // the links kept move down the array, never past one still to be checked
+    uint64_t bitmap[NCSH_BITMAP_WORDS] = {0};
+    int count = 0;
+    for (int i = ncsh_autocompletions_next(node, 0); i < NCSH_LETTERS; i = ncsh_autocompletions_next(node, i + 1)) {
+        ptrdiff_t* const children = ncsh_autocompletions_children(node);
+        children[count++] = children[ncsh_autocompletions_rank(node, i)];
+        bitmap[i / 64] |= 1ULL << (i % 64);
+    }
+    memcpy(node->bitmap, bitmap, sizeof(bitmap));
+    node->nodes_count = (uint8_t)count;
+    node->nodes_capacity = (uint8_t)count;
+    if (!count) {
+        node->nodes = 0;
+    }
+#endif // !NCSH_AUTOCOMPLETIONS_COMPACT
+
+    node->span = 0;
+}
+
+// the best weight a parent can reach through this node: the node itself if it ends a word, or its cached best below it.
+static inline uint_fast32_t ncsh_autocompletions_candidate_weight(const struct ncsh_Autocompletion_Node* const node)
+{
+    if (node->is_end_of_a_word && node->weight > node->best_weight) {
+        return node->weight;
+    }
+    return node->best_weight;
+}
+
+// recomputes the cached best from scratch, for when weights below the node went down.
+static void ncsh_autocompletions_best_update(struct ncsh_Autocompletion_Node* const node)
+{
+    node->best_weight = 0;
+    node->best_index = 0;
+    for (int i = ncsh_autocompletions_next(node, 0); i < NCSH_LETTERS; i = ncsh_autocompletions_next(node, i + 1)) {
+        const uint_fast32_t weight = ncsh_autocompletions_candidate_weight(ncsh_autocompletions_child(node, i));
+        if (weight > node->best_weight) {
+            node->best_weight = (uint32_t)weight;
+            node->best_index = (uint8_t)i;
+        }
+    }
+}
+
+static uint_fast32_t ncsh_autocompletions_children_weight(const struct ncsh_Autocompletion_Node* const node)
+{
+    uint_fast32_t weight = 0;
+    for (int i = ncsh_autocompletions_next(node, 0); i < NCSH_LETTERS; i = ncsh_autocompletions_next(node, i + 1)) {
+        weight += ncsh_autocompletions_child(node, i)->weight;
+    }
+    return weight;
+}
+
+/* The path of a string, for walking back up it after walking down. Nodes don't link to their parents and strings can
+   be MAX_INPUT long, so only the last NCSH_AUTOCOMPLETIONS_TRAIL levels are kept, in a ring, and levels above them are
+   found again by walking down from the root. Only strings longer than the ring pay for that. */
+#define NCSH_AUTOCOMPLETIONS_TRAIL 64
+
+struct ncsh_Autocompletion_Trail {
+    struct ncsh_Autocompletion_Node* root;
+    struct ncsh_Autocompletion_Node* nodes[NCSH_AUTOCOMPLETIONS_TRAIL]; // the node at depth d is in slot d % size
+    uint8_t indexes[NCSH_AUTOCOMPLETIONS_TRAIL];                        // and the index it was reached by
+    size_t low;                                                         // shallowest depth kept
+    size_t high;                                                        // deepest depth kept
+};
+
+static inline void ncsh_autocompletions_trail_start(struct ncsh_Autocompletion_Trail* const trail,
+                                                    struct ncsh_Autocompletion_Node* const root)
+{
+    trail->root = root;
+    trail->nodes[0] = root;
+    trail->low = 0;
+    trail->high = 0;
+}
+
+static inline void ncsh_autocompletions_trail_push(struct ncsh_Autocompletion_Trail* const trail,
+                                                   struct ncsh_Autocompletion_Node* const node,
+                                                   const int index)
+{
+    const size_t slot = ++trail->high % NCSH_AUTOCOMPLETIONS_TRAIL;
+    trail->nodes[slot] = node;
+    trail->indexes[slot] = (uint8_t)index;
+    if (trail->high - trail->low >= NCSH_AUTOCOMPLETIONS_TRAIL) {
+        ++trail->low;
+    }
+}
+
+// makes sure the node at depth and its parent are kept, walking string down from the root again if they aren't.
+// string must still lead down to depth.
+static void ncsh_autocompletions_trail_up(struct ncsh_Autocompletion_Trail* const trail,
+                                          const size_t depth,
+                                          const char* const string,
+                                          const size_t length)
+{
+    assert(depth && depth <= trail->high);
+    if (depth - 1 >= trail->low) {
+        return;
+    }
+
+    const size_t high = depth;
+    ncsh_autocompletions_trail_start(trail, trail->root);
+    for (size_t i = 0; i < length - 1 && trail->high < high; ++i) {
+        int index = ncsh_char_to_index(string[i]);
+        ncsh_autocompletions_trail_push(trail, ncsh_autocompletions_child(trail->nodes[trail->high % NCSH_AUTOCOMPLETIONS_TRAIL], index), index);
+    }
+}
+
+static inline struct ncsh_Autocompletion_Node* ncsh_autocompletions_trail_node(const struct ncsh_Autocompletion_Trail* const trail,
+                                                                               const size_t depth)
+{
+    return trail->nodes[depth % NCSH_AUTOCOMPLETIONS_TRAIL];
+}
+
+static inline uint8_t ncsh_autocompletions_trail_index(const struct ncsh_Autocompletion_Trail* const trail,
+                                                       const size_t depth)
+{
+    return trail->indexes[depth % NCSH_AUTOCOMPLETIONS_TRAIL];
+}
+
+// adds weight to a node's weight, stopping at UINT32_MAX instead of wrapping.
+static inline void ncsh_autocompletions_weight_add(struct ncsh_Autocompletion_Node* const node,
+                                                   const uint_fast32_t weight)
+{
+    node->weight = weight > UINT32_MAX - node->weight ? UINT32_MAX : node->weight + (uint32_t)weight;
+}
+
+// the null byte ends a string, so a string with one before its end can't be stored or found.
+static inline bool ncsh_autocompletions_storable(const char* const string,
+                                                 const size_t length)
+{
+    return !memchr(string, '\0', length - 1);
+}
+
 struct ncsh_Autocompletion_Node* ncsh_autocompletions_alloc(struct ncsh_Arena* const arena)
 {
     struct ncsh_Autocompletion_Node* tree = arena_malloc(arena, 1, struct ncsh_Autocompletion_Node);
@@ -43,180 +435,2023 @@ void ncsh_autocompletions_add(const char* const string,
                               const size_t length,
                               struct ncsh_Autocompletion_Node* restrict tree,
                               struct ncsh_Arena* const arena)
+{
+    ncsh_autocompletions_add_weighted(string, length, 1, tree, arena);
+}
+
+void ncsh_autocompletions_add_weighted(const char* const string,
+                                       const size_t length,
+                                       uint_fast32_t weight,
+                                       struct ncsh_Autocompletion_Node* restrict tree,
+                                       struct ncsh_Arena* const arena)
 {
     assert(string);
     assert(length > 0);
     assert(tree);
-    if (!string || !length || !tree || length > MAX_INPUT) {
+    if (!string || !length || !tree || length > MAX_INPUT || !weight || !ncsh_autocompletions_storable(string, length)) {
         return;
     }
+    if (weight > UINT32_MAX) {
+        weight = UINT32_MAX;
+    }
+
+    struct ncsh_Autocompletion_Trail trail;
+    ncsh_autocompletions_trail_start(&trail, tree);
 
     for (size_t i = 0; i < length - 1; ++i) { // string.length - 1 because it includes null terminator
         int index = ncsh_char_to_index(string[i]);
-        if (index < 0 || index > 96) {
-            continue;
-        }
 
-        if (!tree->nodes[index]) {
-            tree->nodes[index] = arena_malloc(arena, 1, struct ncsh_Autocompletion_Node);
-            tree->nodes[index]->is_end_of_a_word = false;
-            tree->nodes[index]->weight = 1;
+        ncsh_autocompletions_own(tree);
+        struct ncsh_Autocompletion_Node* node = ncsh_autocompletions_child(tree, index);
+        if (!node) {
+            node = ncsh_autocompletions_child_add(tree, index, arena);
+            node->is_end_of_a_word = false;
+            node->weight = (uint32_t)weight;
         }
         else {
-            ++tree->nodes[index]->weight;
+            ncsh_autocompletions_weight_add(node, weight);
         }
 
-        tree = tree->nodes[index];
+        ncsh_autocompletions_trail_push(&trail, node, index);
+        tree = node;
     }
 
     tree->is_end_of_a_word = true;
-}
 
-void ncsh_autocompletions_add_multiple(struct ncsh_String* const strings,
-                                       const int count,
-                                       struct ncsh_Autocompletion_Node* restrict tree,
-                                       struct ncsh_Arena* const arena)
-{
-    if (!strings || count <= 0 || !tree) {
-        return;
-    }
+    // Only the weights along the path went up, so the cached best of each node on it is either the child on the path
+    // or unchanged. Walk back up comparing the two, ties go to the lower index to match lexical traversal order.
+    struct ncsh_Autocompletion_Node* child = tree;
+    for (size_t depth = trail.high; depth > 0; --depth) {
+        ncsh_autocompletions_trail_up(&trail, depth, string, length);
+        struct ncsh_Autocompletion_Node* const parent = ncsh_autocompletions_trail_node(&trail, depth - 1);
+        const uint8_t index = ncsh_autocompletions_trail_index(&trail, depth);
+        const uint_fast32_t candidate = ncsh_autocompletions_candidate_weight(child);
 
-    for (int i = 0; i < count; ++i) {
-        ncsh_autocompletions_add(strings[i].value, strings[i].length, tree, arena);
+        if (index == parent->best_index || candidate > parent->best_weight ||
+            (candidate == parent->best_weight && index < parent->best_index)) {
+            parent->best_weight = (uint32_t)candidate;
+            parent->best_index = index;
+        }
+
+        child = parent;
     }
 }
 
-struct ncsh_Autocompletion_Node* ncsh_autocompletions_search(const char* const string,
-                                                             const size_t length,
-                                                             struct ncsh_Autocompletion_Node* restrict tree)
+// takes up to weight off the string, returns the weight taken or -1 if the string is not in the tree.
+static int_fast64_t ncsh_autocompletions_take(const char* const string,
+                                              const size_t length,
+                                              uint_fast32_t weight,
+                                              struct ncsh_Autocompletion_Node* restrict tree)
 {
     assert(string);
-    assert(length > 0);
     assert(tree);
-    if (!string || !length || !tree) {
-        return NULL;
+    if (!string || !length || !tree || length > MAX_INPUT || !weight) {
+        return -1;
     }
 
-    for (size_t i = 0; i < length - 1; ++i) {
-        int index = ncsh_char_to_index(string[i]);
+    struct ncsh_Autocompletion_Trail trail;
+    ncsh_autocompletions_trail_start(&trail, tree);
+    struct ncsh_Autocompletion_Node* end = tree;
 
-        if (!tree->nodes[index]) {
-            return NULL;
+    for (size_t i = 0; i < length - 1; ++i) { // there is never a child for the null byte, add rejects it
+        int index = ncsh_char_to_index(string[i]);
+        ncsh_autocompletions_own(end);
+        end = ncsh_autocompletions_child(end, index);
+        if (!end) {
+            return -1;
         }
+        ncsh_autocompletions_trail_push(&trail, end, index);
+    }
 
-        tree = tree->nodes[index];
+    if (!trail.high || !end->is_end_of_a_word) {
+        return -1;
     }
 
-    return tree;
+    const uint_fast32_t children_weight = ncsh_autocompletions_children_weight(end);
+    const uint_fast32_t own_weight = end->weight > children_weight ? end->weight - children_weight : 0;
+    if (weight >= own_weight) {
+        weight = own_weight;
+        end->is_end_of_a_word = false;
+    }
+
+    // only links below depth are removed on the way up, so string still leads down to depth for ncsh_autocompletions_trail_up
+    for (size_t depth = trail.high; depth > 0; --depth) {
+        ncsh_autocompletions_trail_up(&trail, depth, string, length);
+        struct ncsh_Autocompletion_Node* const node = ncsh_autocompletions_trail_node(&trail, depth);
+        struct ncsh_Autocompletion_Node* const parent = ncsh_autocompletions_trail_node(&trail, depth - 1);
+        node->weight = node->weight > weight ? node->weight - (uint32_t)weight : 0;
+        if (!node->weight) {
+            ncsh_autocompletions_child_remove(parent, ncsh_autocompletions_trail_index(&trail, depth));
+        }
+        ncsh_autocompletions_best_update(parent);
+    }
+
+    return (int_fast64_t)weight;
 }
 
-struct ncsh_Autocompletion_Node* ncsh_autocompletions_search_string(const struct ncsh_String string,
-                                                                    struct ncsh_Autocompletion_Node* restrict tree)
+bool ncsh_autocompletions_decrement(const char* const string,
+                                    const size_t length,
+                                    uint_fast32_t weight,
+                                    struct ncsh_Autocompletion_Node* restrict tree)
 {
-    return ncsh_autocompletions_search(string.value, string.length, tree);
+    return ncsh_autocompletions_take(string, length, weight, tree) >= 0;
 }
 
-void ncsh_autocompletions_match(struct ncsh_Autocompletion* const matches,
-                                uint_fast32_t* const string_position,
-                                uint_fast8_t* const matches_position,
-                                struct ncsh_Autocompletion_Node* restrict tree,
-                                struct ncsh_Arena* const scratch_arena)
+uint_fast32_t ncsh_autocompletions_remove(const char* const string,
+                                          const size_t length,
+                                          struct ncsh_Autocompletion_Node* restrict tree)
 {
-    for (int i = 0; i < NCSH_LETTERS; ++i) {
-        if (tree->nodes[i]) {
-            if (*matches_position + 1 >= NCSH_MAX_AUTOCOMPLETION_MATCHES) {
-                return;
-            }
+    const int_fast64_t weight = ncsh_autocompletions_take(string, length, UINT32_MAX, tree);
+    return weight > 0 ? (uint_fast32_t)weight : 0;
+}
 
-            if (!matches[*matches_position].value) {
-                matches[*matches_position].value = arena_malloc(scratch_arena, MAX_INPUT, char);
+static void ncsh_autocompletions_merge_node(struct ncsh_Autocompletion_Node* const destination,
+                                            const struct ncsh_Autocompletion_Node* const node,
+                                            char* const word,
+                                            const size_t depth,
+                                            struct ncsh_Arena* const arena)
+{
+    if (depth && node->is_end_of_a_word) {
+        const uint_fast32_t children_weight = ncsh_autocompletions_children_weight(node);
+        if (node->weight > children_weight) {
+            ncsh_autocompletions_add_weighted(word, depth + 1, node->weight - children_weight, destination, arena);
+        }
+    }
+    if (depth >= MAX_INPUT - 1) {
+        return;
+    }
 
-                if (*string_position > 0 && *matches_position > 0) {
-                    memcpy(matches[*matches_position].value, matches[*matches_position - 1].value, *string_position);
-                }
-            }
+    for (int i = ncsh_autocompletions_next(node, 0); i < NCSH_LETTERS; i = ncsh_autocompletions_next(node, i + 1)) {
+        word[depth] = ncsh_index_to_char(i);
+        ncsh_autocompletions_merge_node(destination, ncsh_autocompletions_child(node, i), word, depth + 1, arena);
+    }
+}
 
-            matches[*matches_position].value[*string_position] = ncsh_index_to_char(i);
-            ++*string_position;
-            matches[*matches_position].value[*string_position] = '\0';
+void ncsh_autocompletions_merge(struct ncsh_Autocompletion_Node* restrict destination,
+                                const struct ncsh_Autocompletion_Node* restrict source,
+                                struct ncsh_Arena* const arena)
+{
+    if (!destination || !source || !arena) {
+        return;
+    }
 
-            if (tree->nodes[i]->is_end_of_a_word) {
-                matches[*matches_position].weight = tree->nodes[i]->weight;
-                ++*matches_position;
-            }
+    char word[MAX_INPUT];
+    ncsh_autocompletions_merge_node(destination, source, word, 0, arena);
+}
 
-            ncsh_autocompletions_match(matches, string_position, matches_position, tree->nodes[i], scratch_arena);
+// halves the weight of the words at and below node, unlinking children left with none. returns the node's new weight.
+static uint_fast32_t ncsh_autocompletions_decay_node(struct ncsh_Autocompletion_Node* const node,
+                                                     const size_t depth)
+{
+    uint_fast32_t children_weight = 0;
+    uint_fast32_t decayed_weight = 0;
+    ncsh_autocompletions_own(node);
+    node->best_weight = 0;
+    node->best_index = 0;
 
-            if (matches[*matches_position].value) {
-                if (*matches_position + 1 < NCSH_MAX_AUTOCOMPLETION_MATCHES) {
-                    ++*matches_position;
-                }
-                else {
-                    return;
-                }
-            }
+    for (int i = ncsh_autocompletions_next(node, 0); i < NCSH_LETTERS; i = ncsh_autocompletions_next(node, i + 1)) {
+        struct ncsh_Autocompletion_Node* const child = ncsh_autocompletions_child(node, i);
+        children_weight += child->weight;
+        // only a damaged image has nodes deeper than a string can reach
+        uint_fast32_t weight = depth < MAX_INPUT - 1 ? ncsh_autocompletions_decay_node(child, depth + 1) : 0;
+        if (!weight) {
+            ncsh_autocompletions_child_remove(node, i);
+            continue;
+        }
+        decayed_weight += weight;
 
-            *string_position = *string_position - 1;
+        const uint_fast32_t candidate = ncsh_autocompletions_candidate_weight(child);
+        if (candidate > node->best_weight) {
+            node->best_weight = (uint32_t)candidate;
+            node->best_index = (uint8_t)i;
         }
     }
+
+    const uint_fast32_t own_weight = node->weight > children_weight ? (node->weight - children_weight) / 2 : 0;
+    node->is_end_of_a_word = node->is_end_of_a_word && own_weight;
+    node->weight = (uint32_t)(own_weight + decayed_weight);
+    return node->weight;
 }
 
-uint_fast8_t ncsh_autocompletions_matches(struct ncsh_Autocompletion* const matches,
-                                          struct ncsh_Autocompletion_Node* restrict tree,
-                                          struct ncsh_Arena* const scratch_arena)
+void ncsh_autocompletions_decay(struct ncsh_Autocompletion_Node* restrict tree)
 {
-    uint_fast32_t string_position = 0;
-    uint_fast8_t matches_position = 0;
+    if (!tree) {
+        return;
+    }
+
+    // the root is not counted by add, its weight stays 0
+    bool is_end_of_a_word = tree->is_end_of_a_word;
+    ncsh_autocompletions_decay_node(tree, 0);
+    tree->weight = 0;
+    tree->is_end_of_a_word = is_end_of_a_word;
+}
 
-    ncsh_autocompletions_match(matches, &string_position, &matches_position, tree, scratch_arena);
+static size_t ncsh_autocompletions_count_node(const struct ncsh_Autocompletion_Node* const node,
+                                              const size_t depth)
+{
+    size_t count = 1;
+    if (depth >= MAX_INPUT - 1) {
+        return count;
+    }
 
-    return matches_position;
+    for (int i = ncsh_autocompletions_next(node, 0); i < NCSH_LETTERS; i = ncsh_autocompletions_next(node, i + 1)) {
+        count += ncsh_autocompletions_count_node(ncsh_autocompletions_child(node, i), depth + 1);
+    }
+    return count;
 }
 
-uint_fast8_t ncsh_autocompletions_get(const char* const search,
-                                      const size_t search_length,
-                                      struct ncsh_Autocompletion* matches,
-                                      struct ncsh_Autocompletion_Node* restrict tree,
-                                      struct ncsh_Arena scratch_arena)
+size_t ncsh_autocompletions_count(const struct ncsh_Autocompletion_Node* restrict tree)
 {
-    struct ncsh_Autocompletion_Node* const search_result = ncsh_autocompletions_search(search, search_length, tree);
-    if (!search_result) {
+    if (!tree) {
         return 0;
     }
 
-    uint_fast8_t match_count = ncsh_autocompletions_matches(matches, search_result, &scratch_arena);
-    if (!match_count) {
-        return 0;
+    return ncsh_autocompletions_count_node(tree, 0);
+}
+
+uint_fast16_t ncsh_autocompletions_frecency(const time_t used_time,
+                                            const time_t now)
+{
+    time_t age = now > used_time ? now - used_time : 0;
+    time_t half_lives = age / NCSH_AUTOCOMPLETIONS_HALF_LIFE;
+    if (half_lives >= (time_t)(sizeof(uint_fast16_t) * 8)) {
+        return 1;
     }
+    uint_fast16_t weight = (uint_fast16_t)NCSH_AUTOCOMPLETIONS_RECENT >> half_lives;
+    return weight ? weight : 1;
+}
 
-    return match_count;
+void ncsh_autocompletions_add_multiple(struct ncsh_String* const strings,
+                                       const int count,
+                                       struct ncsh_Autocompletion_Node* restrict tree,
+                                       struct ncsh_Arena* const arena)
+{
+    if (!strings || count <= 0 || !tree) {
+        return;
+    }
+
+    for (int i = 0; i < count; ++i) {
+        ncsh_autocompletions_add(strings[i].value, strings[i].length, tree, arena);
+    }
 }
 
-uint_fast8_t ncsh_autocompletions_first(const char* const search,
-                                        const size_t search_length,
-                                        char* match,
-                                        struct ncsh_Autocompletion_Node* restrict tree,
-                                        struct ncsh_Arena scratch_arena)
+/* Bulk loading.
+   The strings are sorted so every subtree is a run of them sharing a prefix.
+   A node's weight is then the sum of the weights of its run, and its children are the runs of its run split on the
+   next character, so each node can be written before its subtree with no node visited twice. */
+struct ncsh_Autocompletion_Key {
+    const char* value; // null terminated
+    uint_fast64_t weight;
+};
+
+static int ncsh_autocompletions_key_compare(const void* const lhs,
+                                            const void* const rhs)
 {
-    struct ncsh_Autocompletion_Node* search_result = ncsh_autocompletions_search(search, search_length, tree);
-    if (!search_result) {
-        return 0;
+    return strcmp(((const struct ncsh_Autocompletion_Key*)lhs)->value, ((const struct ncsh_Autocompletion_Key*)rhs)->value);
+}
+
+// builds the node for keys[start, end), which share their first depth characters, then its subtree.
+// sums[i] is the total weight of keys[0, i).
+static struct ncsh_Autocompletion_Node* ncsh_autocompletions_load_node(const struct ncsh_Autocompletion_Key* const keys,
+                                                                       const uint_fast64_t* const sums,
+                                                                       size_t start,
+                                                                       const size_t end,
+                                                                       const size_t depth,
+                                                                       struct ncsh_Arena* const arena)
+{
+    struct ncsh_Autocompletion_Node* const node = arena_malloc(arena, 1, struct ncsh_Autocompletion_Node);
+    node->weight = sums[end] - sums[start] > UINT32_MAX ? UINT32_MAX : (uint32_t)(sums[end] - sums[start]);
+    if (start < end && !keys[start].value[depth]) {
+        node->is_end_of_a_word = true;
+        ++start;
     }
 
-    struct ncsh_Autocompletion matches[NCSH_MAX_AUTOCOMPLETION_MATCHES] = {0};
-    uint_fast8_t matches_count = ncsh_autocompletions_matches(matches, search_result, &scratch_arena);
-    if (!matches_count) {
-        return 0;
+#ifdef NCSH_AUTOCOMPLETIONS_COMPACT
+    int count = 0;
+    for (size_t i = start; i < end; ++i) {
+        count += i == start || keys[i].value[depth] != keys[i - 1].value[depth];
     }
+    ptrdiff_t* children = NULL;
+    if (count) {
+        children = arena_malloc_uninitialized(arena, count, ptrdiff_t);
+        node->nodes = ncsh_autocompletions_offset(node, children);
+        node->nodes_count = (uint8_t)count;
+        node->nodes_capacity = (uint8_t)count;
+    }
+    int rank = 0;
+#endif // NCSH_AUTOCOMPLETIONS_COMPACT
+
+    for (size_t i = start; i < end;) {
+        size_t next = i + 1;
+        while (next < end && keys[next].value[depth] == keys[i].value[depth]) {
+            ++next;
+        }
+
+        const int index = ncsh_char_to_index(keys[i].value[depth]);
+        struct ncsh_Autocompletion_Node* const child = ncsh_autocompletions_load_node(keys, sums, i, next, depth + 1, arena);
+#ifdef NCSH_AUTOCOMPLETIONS_COMPACT
+        children[rank++] = ncsh_autocompletions_offset(node, child);
+        node->bitmap[index / 64] |= 1ULL << (index % 64);
+#else
+        ptrdiff_t* block = ncsh_autocompletions_block(node, index);
+        if (!block) {
+            block = arena_malloc(arena, NCSH_DENSE_BLOCK, ptrdiff_t);
+            node->nodes[index / NCSH_DENSE_BLOCK] = ncsh_autocompletions_offset(node, block);
+        }
+        block[index % NCSH_DENSE_BLOCK] = ncsh_autocompletions_offset(node, child);
+#endif // NCSH_AUTOCOMPLETIONS_COMPACT
 
-    struct ncsh_Autocompletion potential_match = matches[0];
-    for (uint_fast8_t i = 1; i < matches_count; ++i) {
-        if (matches[i].weight > potential_match.weight) {
-            potential_match = matches[i];
+        // children come in index order, so keeping the first of equal candidates gives ties to the lower index
+        const uint_fast32_t candidate = ncsh_autocompletions_candidate_weight(child);
+        if (candidate > node->best_weight) {
+            node->best_weight = (uint32_t)candidate;
+            node->best_index = (uint8_t)index;
         }
+        i = next;
+    }
+
+    return node;
+}
+
+struct ncsh_Autocompletion_Node* ncsh_autocompletions_load(const struct ncsh_String* const strings,
+                                                           const uint_fast32_t* const weights,
+                                                           const int count,
+                                                           struct ncsh_Arena* const arena,
+                                                           struct ncsh_Arena scratch_arena)
+{
+    if (!strings || count <= 0) {
+        return ncsh_autocompletions_alloc(arena);
     }
 
-    memcpy(match, potential_match.value, MAX_INPUT);
+    struct ncsh_Autocompletion_Key* const keys = arena_malloc_uninitialized(&scratch_arena, count, struct ncsh_Autocompletion_Key);
+    size_t keys_count = 0;
+    for (int i = 0; i < count; ++i) {
+        const char* const value = strings[i].value;
+        const size_t length = strings[i].length;
+        uint_fast32_t weight = weights ? weights[i] : 1;
+        if (!value || !length || length > MAX_INPUT || !weight || !ncsh_autocompletions_storable(value, length)) {
+            continue;
+        }
+
+        // strings are referenced in place unless they aren't terminated where their length says
+        if (!value[length - 1]) {
+            keys[keys_count].value = value;
+        }
+        else {
+            char* const terminated = arena_malloc_uninitialized(&scratch_arena, length, char);
+            memcpy(terminated, value, length - 1);
+            terminated[length - 1] = '\0';
+            keys[keys_count].value = terminated;
+        }
+        keys[keys_count].weight = weight > UINT32_MAX ? UINT32_MAX : weight;
+        ++keys_count;
+    }
 
-    return 1;
+    // merges duplicates, adding up their weights like add does
+    qsort(keys, keys_count, sizeof(*keys), ncsh_autocompletions_key_compare);
+    size_t unique = 0;
+    for (size_t i = 0; i < keys_count; ++i) {
+        if (!unique || strcmp(keys[i].value, keys[unique - 1].value)) {
+            keys[unique++] = keys[i];
+        }
+        else {
+            keys[unique - 1].weight += keys[i].weight;
+            if (keys[unique - 1].weight > UINT32_MAX) {
+                keys[unique - 1].weight = UINT32_MAX;
+            }
+        }
+    }
+
+    uint_fast64_t* const sums = arena_malloc_uninitialized(&scratch_arena, unique + 1, uint_fast64_t);
+    sums[0] = 0;
+    for (size_t i = 0; i < unique; ++i) {
+        sums[i + 1] = sums[i] + keys[i].weight;
+    }
+
+    // the root is not counted by add, its weight stays 0
+    struct ncsh_Autocompletion_Node* const tree = ncsh_autocompletions_load_node(keys, sums, 0, unique, 0, arena);
+    tree->weight = 0;
+    return tree;
+}
+
+struct ncsh_Autocompletion_Node* ncsh_autocompletions_search(const char* const string,
+                                                             const size_t length,
+                                                             struct ncsh_Autocompletion_Node* restrict tree)
+{
+    assert(string);
+    assert(length > 0);
+    assert(tree);
+    if (!string || !length || !tree) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < length - 1; ++i) { // there is never a child for the null byte
+        int index = ncsh_char_to_index(string[i]);
+        tree = ncsh_autocompletions_child(tree, index);
+        if (!tree) {
+            return NULL;
+        }
+    }
+
+    return tree;
+}
+
+struct ncsh_Autocompletion_Node* ncsh_autocompletions_search_string(const struct ncsh_String string,
+                                                                    struct ncsh_Autocompletion_Node* restrict tree)
+{
+    return ncsh_autocompletions_search(string.value, string.length, tree);
+}
+
+#define NCSH_AUTOCOMPLETIONS_CLOCK_EVERY 256 // nodes visited between looks at the clock by searches with a budget
+
+// microseconds on the monotonic clock, for the budgets.
+static inline uint_fast64_t ncsh_autocompletions_clock(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint_fast64_t)now.tv_sec * 1000000 + (uint_fast64_t)now.tv_nsec / 1000;
+}
+
+/* Best-first traversal for ncsh_autocompletions_get.
+   The queue holds nodes to expand, prioritized by the best weight reachable through them, and words ready to be
+   emitted, prioritized by their own weight. Since a node's priority is an exact bound on everything below it, words
+   come off the queue in weight order. Ties go to the entry pushed last, so equal weights are walked depth first
+   and come out in lexical order, instead of breadth first through every node above the deepest match.
+   A node's path is only allocated when it is expanded, most pushed nodes never are. */
+struct ncsh_Autocompletion_Path {
+    struct ncsh_Autocompletion_Path* parent;
+    uint16_t length;
+    char character;
+    uint32_t span; // 1 + the first packed match written through this node, 0 if none
+};
+
+struct ncsh_Autocompletion_Entry {
+    struct ncsh_Autocompletion_Node* node;
+    struct ncsh_Autocompletion_Path* path; // of the parent for nodes, of the word itself for matches
+    uint32_t order;                        // insertion order, the later entry wins ties
+    uint32_t weight;
+    char character;                        // from the parent to the node, '\0' for the search result and matches
+    bool is_match;
+};
+
+struct ncsh_Autocompletion_Queue {
+    struct ncsh_Autocompletion_Entry* entries;
+    uint_fast32_t count;
+    uint_fast32_t capacity;
+    uint_fast32_t order;
+};
+
+static inline bool ncsh_autocompletions_entry_before(const struct ncsh_Autocompletion_Entry* const a,
+                                                     const struct ncsh_Autocompletion_Entry* const b)
+{
+    return a->weight > b->weight || (a->weight == b->weight && a->order > b->order);
+}
+
+static void ncsh_autocompletions_queue_push(struct ncsh_Autocompletion_Queue* const queue,
+                                            struct ncsh_Autocompletion_Node* const node,
+                                            struct ncsh_Autocompletion_Path* const path,
+                                            const char character,
+                                            const uint_fast32_t weight,
+                                            const bool is_match,
+                                            struct ncsh_Arena* const scratch_arena)
+{
+    if (queue->count == queue->capacity) {
+        uint_fast32_t capacity = queue->capacity * 2;
+        queue->entries = arena_realloc(scratch_arena, capacity, struct ncsh_Autocompletion_Entry, queue->entries, queue->count);
+        queue->capacity = capacity;
+    }
+
+    struct ncsh_Autocompletion_Entry entry = {
+        .node = node, .path = path, .order = (uint32_t)queue->order++, .weight = (uint32_t)weight,
+        .character = character, .is_match = is_match
+    };
+    uint_fast32_t position = queue->count++;
+    while (position > 0) {
+        uint_fast32_t parent = (position - 1) / 2;
+        if (!ncsh_autocompletions_entry_before(&entry, &queue->entries[parent])) {
+            break;
+        }
+        queue->entries[position] = queue->entries[parent];
+        position = parent;
+    }
+    queue->entries[position] = entry;
+}
+
+static struct ncsh_Autocompletion_Entry ncsh_autocompletions_queue_pop(struct ncsh_Autocompletion_Queue* const queue)
+{
+    struct ncsh_Autocompletion_Entry top = queue->entries[0];
+    struct ncsh_Autocompletion_Entry last = queue->entries[--queue->count];
+    uint_fast32_t position = 0;
+    for (;;) {
+        uint_fast32_t child = position * 2 + 1;
+        if (child >= queue->count) {
+            break;
+        }
+        if (child + 1 < queue->count && ncsh_autocompletions_entry_before(&queue->entries[child + 1], &queue->entries[child])) {
+            ++child;
+        }
+        if (!ncsh_autocompletions_entry_before(&queue->entries[child], &last)) {
+            break;
+        }
+        queue->entries[position] = queue->entries[child];
+        position = child;
+    }
+    queue->entries[position] = last;
+    return top;
+}
+
+// writes the word of a match entry to value, which has room for its characters and the null terminator.
+static void ncsh_autocompletions_entry_copy(const struct ncsh_Autocompletion_Entry* const entry, char* const value)
+{
+    value[entry->path->length] = '\0';
+    for (struct ncsh_Autocompletion_Path* path = entry->path; path; path = path->parent) {
+        value[path->length - 1] = path->character;
+    }
+}
+
+/* The traversal shared by ncsh_autocompletions_get_node, ncsh_autocompletions_get_node_packed and
+   ncsh_autocompletions_get_budgeted. Matches go to matches with values allocated from the scratch arena, or when
+   matches is NULL, to spans with values written into buffer, stopping at the first one that doesn't fit.
+   With a deadline, the walk stops once the clock is past it and clears complete. */
+static uint_fast32_t ncsh_autocompletions_collect(struct ncsh_Autocompletion* matches,
+                                                  struct ncsh_Autocompletion_Span* spans,
+                                                  char* const buffer,
+                                                  const size_t buffer_size,
+                                                  const uint_fast32_t max_matches,
+                                                  const uint_fast64_t deadline,
+                                                  bool* const complete,
+                                                  struct ncsh_Autocompletion_Node* restrict search_result,
+                                                  struct ncsh_Arena scratch_arena)
+{
+    if (!search_result || !search_result->best_weight || !max_matches) {
+        return 0;
+    }
+
+    struct ncsh_Autocompletion_Queue queue = { .capacity = 64 };
+    queue.entries = arena_malloc(&scratch_arena, queue.capacity, struct ncsh_Autocompletion_Entry);
+    ncsh_autocompletions_queue_push(&queue, search_result, NULL, '\0', search_result->best_weight, false, &scratch_arena);
+
+    uint_fast32_t match_count = 0;
+    size_t used = 0;
+    uint_fast32_t popped = 0;
+    while (queue.count && match_count < max_matches) {
+        if (deadline && !(++popped % NCSH_AUTOCOMPLETIONS_CLOCK_EVERY) && ncsh_autocompletions_clock() > deadline) {
+            *complete = false;
+            break;
+        }
+        struct ncsh_Autocompletion_Entry entry = ncsh_autocompletions_queue_pop(&queue);
+
+        if (entry.is_match) {
+            if (matches) {
+                char* value = arena_malloc_uninitialized(&scratch_arena, entry.path->length + 1, char);
+                ncsh_autocompletions_entry_copy(&entry, value);
+                matches[match_count].value = value;
+                matches[match_count].weight = entry.weight;
+            }
+            else {
+                // the characters up to the deepest node an earlier match went through are already in the buffer
+                struct ncsh_Autocompletion_Path* shared = entry.path;
+                while (shared && !shared->span) {
+                    shared = shared->parent;
+                }
+                const size_t prefix = shared ? shared->length : 0;
+                const size_t suffix = entry.path->length - prefix;
+                if (buffer_size - used < suffix + 1) {
+                    break;
+                }
+                buffer[used + suffix] = '\0';
+                for (struct ncsh_Autocompletion_Path* path = entry.path; path != shared; path = path->parent) {
+                    buffer[used + path->length - 1 - prefix] = path->character;
+                    path->span = match_count + 1;
+                }
+                spans[match_count].offset = (uint32_t)used;
+                spans[match_count].length = (uint16_t)(entry.path->length + 1);
+                spans[match_count].weight = entry.weight;
+                spans[match_count].prefix = (uint16_t)prefix;
+                spans[match_count].parent = shared ? shared->span - 1 : 0;
+                used += suffix + 1;
+            }
+            ++match_count;
+            continue;
+        }
+
+        struct ncsh_Autocompletion_Path* path = entry.path;
+        if (entry.character) {
+            path = arena_malloc_uninitialized(&scratch_arena, 1, struct ncsh_Autocompletion_Path);
+            path->parent = entry.path;
+            path->length = (uint16_t)(entry.path ? entry.path->length + 1 : 1);
+            path->character = entry.character;
+            path->span = 0;
+        }
+
+        // pushed last to first, so among equal weights the word comes before its continuations and children in order.
+        // only a damaged image has nodes deeper than a string can reach.
+        int children[NCSH_LETTERS];
+        int children_count = 0;
+        const int end = !path || path->length < MAX_INPUT - 1 ? NCSH_LETTERS : 0;
+        for (int i = ncsh_autocompletions_next(entry.node, 0); i < end; i = ncsh_autocompletions_next(entry.node, i + 1)) {
+            children[children_count++] = i;
+        }
+        while (children_count) {
+            int i = children[--children_count];
+            struct ncsh_Autocompletion_Node* const node = ncsh_autocompletions_child(entry.node, i);
+            ncsh_autocompletions_queue_push(&queue, node, path, ncsh_index_to_char(i), ncsh_autocompletions_candidate_weight(node),
+                                            false, &scratch_arena);
+        }
+
+        // the search result itself is not a match, there is nothing left to complete
+        if (entry.character && entry.node->is_end_of_a_word) {
+            ncsh_autocompletions_queue_push(&queue, entry.node, path, '\0', entry.node->weight, true, &scratch_arena);
+        }
+    }
+
+    return match_count;
+}
+
+uint_fast32_t ncsh_autocompletions_get_node(struct ncsh_Autocompletion* matches,
+                                            const uint_fast32_t max_matches,
+                                            struct ncsh_Autocompletion_Node* restrict search_result,
+                                            struct ncsh_Arena scratch_arena)
+{
+    if (!matches) {
+        return 0;
+    }
+    return ncsh_autocompletions_collect(matches, NULL, NULL, 0, max_matches, 0, NULL, search_result, scratch_arena);
+}
+
+uint_fast32_t ncsh_autocompletions_get_node_packed(struct ncsh_Autocompletion_Span* matches,
+                                                   const uint_fast32_t max_matches,
+                                                   char* buffer,
+                                                   const size_t buffer_size,
+                                                   struct ncsh_Autocompletion_Node* restrict search_result,
+                                                   struct ncsh_Arena scratch_arena)
+{
+    if (!matches || !buffer) {
+        return 0;
+    }
+    return ncsh_autocompletions_collect(NULL, matches, buffer, buffer_size, max_matches, 0, NULL, search_result,
+                                        scratch_arena);
+}
+
+void ncsh_autocompletions_span_value(const struct ncsh_Autocompletion_Span* const matches,
+                                     const uint_fast32_t index,
+                                     const char* const buffer,
+                                     char* const value)
+{
+    // each match a value shares a prefix with wrote the characters from its own prefix on, which is shorter
+    const struct ncsh_Autocompletion_Span* span = &matches[index];
+    memcpy(value + span->prefix, buffer + span->offset, (size_t)(span->length - span->prefix));
+    for (size_t end = span->prefix; end; end = span->prefix) {
+        span = &matches[span->parent];
+        memcpy(value + span->prefix, buffer + span->offset, end - span->prefix);
+    }
+}
+
+uint_fast32_t ncsh_autocompletions_get(const char* const search,
+                                       const size_t search_length,
+                                       struct ncsh_Autocompletion* matches,
+                                       const uint_fast32_t max_matches,
+                                       struct ncsh_Autocompletion_Node* restrict tree,
+                                       struct ncsh_Arena scratch_arena)
+{
+    return ncsh_autocompletions_get_node(matches, max_matches, ncsh_autocompletions_search(search, search_length, tree),
+                                         scratch_arena);
+}
+
+uint_fast32_t ncsh_autocompletions_get_budgeted(const char* const search,
+                                                const size_t search_length,
+                                                struct ncsh_Autocompletion* matches,
+                                                const uint_fast32_t max_matches,
+                                                const uint_fast32_t budget,
+                                                bool* const complete,
+                                                struct ncsh_Autocompletion_Node* restrict tree,
+                                                struct ncsh_Arena scratch_arena)
+{
+    bool finished = true;
+    uint_fast32_t count = 0;
+    if (matches) {
+        const uint_fast64_t deadline = ncsh_autocompletions_clock() + budget;
+        count = ncsh_autocompletions_collect(matches, NULL, NULL, 0, max_matches, deadline, &finished,
+                                             ncsh_autocompletions_search(search, search_length, tree), scratch_arena);
+    }
+    if (complete) {
+        *complete = finished;
+    }
+    return count;
+}
+
+uint_fast32_t ncsh_autocompletions_get_packed(const char* const search,
+                                              const size_t search_length,
+                                              struct ncsh_Autocompletion_Span* matches,
+                                              const uint_fast32_t max_matches,
+                                              char* buffer,
+                                              const size_t buffer_size,
+                                              struct ncsh_Autocompletion_Node* restrict tree,
+                                              struct ncsh_Arena scratch_arena)
+{
+    return ncsh_autocompletions_get_node_packed(matches, max_matches, buffer, buffer_size,
+                                                ncsh_autocompletions_search(search, search_length, tree), scratch_arena);
+}
+
+uint_fast8_t ncsh_autocompletions_first_node(char* match,
+                                             struct ncsh_Autocompletion_Node* restrict search_result)
+{
+    if (!search_result || !search_result->best_weight) {
+        return 0;
+    }
+
+    // follow the cached best child down until reaching the word it was cached for.
+    // a word ending at a node wins ties against words below it, same as a lexical traversal would find it first.
+    // a damaged image can cache a best child that isn't there, the match then stops short of a word.
+    size_t position = 0;
+    struct ncsh_Autocompletion_Node* node = search_result;
+    while (position < MAX_INPUT - 1) {
+        struct ncsh_Autocompletion_Node* const child = ncsh_autocompletions_child(node, node->best_index);
+        if (!child) {
+            break;
+        }
+        match[position++] = ncsh_index_to_char(node->best_index);
+        node = child;
+        if (node->is_end_of_a_word && node->weight >= node->best_weight) {
+            break;
+        }
+    }
+    match[position] = '\0';
+
+    return position > 0;
+}
+
+uint_fast8_t ncsh_autocompletions_first(const char* const search,
+                                        const size_t search_length,
+                                        char* match,
+                                        struct ncsh_Autocompletion_Node* restrict tree)
+{
+    return ncsh_autocompletions_first_node(match, ncsh_autocompletions_search(search, search_length, tree));
+}
+
+/* Fuzzy search.
+   A depth first walk of the tree that scores the query against each path as it goes, like fzf's v2 algorithm: each
+   depth keeps the best score for every number of query characters matched so far, split by whether the last character
+   was matched, so the best alignment is found rather than the first one. A row is computed from the row of the depth
+   above, which stays valid while the subtree under it is walked. Rows are only made for the depths the walk reaches.
+   A subtree is skipped when even matching every remaining query character at the highest bonus can't beat the worst
+   result kept, or can only tie it with a lower weight than the one kept. */
+enum ncsh_Autocompletion_Fuzzy_Score {
+    NCSH_FUZZY_MATCH = 16,
+    NCSH_FUZZY_GAP_START = -3,
+    NCSH_FUZZY_GAP_EXTENSION = -1,
+    NCSH_FUZZY_BOUNDARY = 8,
+    NCSH_FUZZY_CAMEL = 7,
+    NCSH_FUZZY_CONSECUTIVE = 4,
+    NCSH_FUZZY_FIRST_MULTIPLIER = 2
+};
+
+#define NCSH_FUZZY_NONE (INT32_MIN / 2) // score of an alignment that isn't possible
+
+struct ncsh_Autocompletion_Fuzzy_Frame {
+    struct ncsh_Autocompletion_Node* node;
+    uint_fast32_t depth; // length of the word up to and including character
+    char character;
+};
+
+// the scores at one depth, indexed by query characters matched.
+struct ncsh_Autocompletion_Fuzzy_Row {
+    int32_t* matched;    // best score with the last character matched
+    int32_t* bonus;      // bonus that last character was matched with, carried along consecutive matches
+    int32_t* gap;        // best score with the last character not matched
+};
+
+#define NCSH_FUZZY_ROWS 64 // depths with a row to start with, doubled when the walk goes deeper
+
+// the rows and the word down to the deepest depth reached so far.
+struct ncsh_Autocompletion_Fuzzy_Rows {
+    struct ncsh_Autocompletion_Fuzzy_Row* rows;
+    char* word;
+    uint_fast32_t capacity; // depths with a row
+};
+
+struct ncsh_Autocompletion_Fuzzy_Result {
+    char* value;
+    int_fast32_t score;
+    uint_fast32_t weight;
+    uint_fast32_t order;
+};
+
+struct ncsh_Autocompletion_Fuzzy_Results {
+    struct ncsh_Autocompletion_Fuzzy_Result* entries; // min heap, worst result first
+    uint_fast32_t count;
+    uint_fast32_t capacity;
+    uint_fast32_t order;
+};
+
+static inline bool ncsh_autocompletions_fuzzy_worse(const struct ncsh_Autocompletion_Fuzzy_Result* const a,
+                                                    const struct ncsh_Autocompletion_Fuzzy_Result* const b)
+{
+    if (a->score != b->score) {
+        return a->score < b->score;
+    }
+    if (a->weight != b->weight) {
+        return a->weight < b->weight;
+    }
+    return a->order > b->order;
+}
+
+// true if a result with score and weight would be kept.
+static inline bool ncsh_autocompletions_fuzzy_fits(const struct ncsh_Autocompletion_Fuzzy_Results* const results,
+                                                   const int_fast32_t score,
+                                                   const uint_fast32_t weight)
+{
+    if (results->count < results->capacity) {
+        return true;
+    }
+    const struct ncsh_Autocompletion_Fuzzy_Result* const worst = results->entries;
+    return score > worst->score || (score == worst->score && weight > worst->weight);
+}
+
+static void ncsh_autocompletions_fuzzy_sift_down(struct ncsh_Autocompletion_Fuzzy_Results* const results,
+                                                 uint_fast32_t i)
+{
+    struct ncsh_Autocompletion_Fuzzy_Result* const entries = results->entries;
+    for (;;) {
+        uint_fast32_t worst = i;
+        uint_fast32_t left = 2 * i + 1;
+        uint_fast32_t right = left + 1;
+        if (left < results->count && ncsh_autocompletions_fuzzy_worse(&entries[left], &entries[worst])) {
+            worst = left;
+        }
+        if (right < results->count && ncsh_autocompletions_fuzzy_worse(&entries[right], &entries[worst])) {
+            worst = right;
+        }
+        if (worst == i) {
+            return;
+        }
+        struct ncsh_Autocompletion_Fuzzy_Result temp = entries[i];
+        entries[i] = entries[worst];
+        entries[worst] = temp;
+        i = worst;
+    }
+}
+
+static void ncsh_autocompletions_fuzzy_add(struct ncsh_Autocompletion_Fuzzy_Results* const results,
+                                           const char* const word,
+                                           const uint_fast32_t length,
+                                           const int_fast32_t score,
+                                           const uint_fast32_t weight,
+                                           struct ncsh_Arena* const scratch_arena)
+{
+    struct ncsh_Autocompletion_Fuzzy_Result result = { .score = score, .weight = weight, .order = results->order++ };
+    result.value = arena_malloc_uninitialized(scratch_arena, length + 1, char);
+    memcpy(result.value, word, length);
+    result.value[length] = '\0';
+
+    struct ncsh_Autocompletion_Fuzzy_Result* const entries = results->entries;
+    if (results->count == results->capacity) {
+        entries[0] = result;
+        ncsh_autocompletions_fuzzy_sift_down(results, 0);
+        return;
+    }
+
+    uint_fast32_t i = results->count++;
+    while (i) {
+        uint_fast32_t parent = (i - 1) / 2;
+        if (!ncsh_autocompletions_fuzzy_worse(&result, &entries[parent])) {
+            break;
+        }
+        entries[i] = entries[parent];
+        i = parent;
+    }
+    entries[i] = result;
+}
+
+static inline bool ncsh_autocompletions_fuzzy_is_boundary(const char previous)
+{
+    return previous == ' ' || previous == '/' || previous == '-' || previous == '_' || previous == '.' ||
+           previous == '=' || previous == ':' || previous == ',' || previous == '"' || previous == '\'';
+}
+
+// the character as compared against the query, lowercase when case is ignored.
+static inline char ncsh_autocompletions_fuzzy_fold(const char character,
+                                                   const bool ignore_case)
+{
+    return ignore_case && character >= 'A' && character <= 'Z' ? (char)(character - 'A' + 'a') : character;
+}
+
+// smart case: a query without uppercase characters matches either case.
+static inline bool ncsh_autocompletions_fuzzy_ignore_case(const char* const query,
+                                                          const uint_fast32_t query_characters)
+{
+    for (uint_fast32_t i = 0; i < query_characters; ++i) {
+        if (query[i] >= 'A' && query[i] <= 'Z') {
+            return false;
+        }
+    }
+    return true;
+}
+
+struct ncsh_Autocompletion_Fuzzy_Stack {
+    struct ncsh_Autocompletion_Fuzzy_Frame* frames;
+    uint_fast32_t count;
+    uint_fast32_t capacity;
+};
+
+// pushes the children of the frame's node, ordered so the heaviest comes off the stack first, then by index. popular
+// words are found early, which makes the pruning bound tight sooner and means they are the ones found if the budget
+// runs out.
+static void ncsh_autocompletions_fuzzy_push(struct ncsh_Autocompletion_Fuzzy_Stack* const stack,
+                                            const struct ncsh_Autocompletion_Fuzzy_Frame* const frame,
+                                            struct ncsh_Arena* const scratch_arena)
+{
+    const uint_fast32_t first_child = stack->count;
+    for (int i = ncsh_autocompletions_next(frame->node, 0); i < NCSH_LETTERS; i = ncsh_autocompletions_next(frame->node, i + 1)) {
+        if (stack->count == stack->capacity) {
+            stack->frames = arena_realloc(scratch_arena, stack->capacity * 2, struct ncsh_Autocompletion_Fuzzy_Frame, stack->frames, stack->capacity);
+            stack->capacity *= 2;
+        }
+        stack->frames[stack->count++] = (struct ncsh_Autocompletion_Fuzzy_Frame){
+            .node = ncsh_autocompletions_child(frame->node, i),
+            .depth = frame->depth + 1,
+            .character = ncsh_index_to_char(i),
+        };
+    }
+
+    struct ncsh_Autocompletion_Fuzzy_Frame* const frames = stack->frames;
+    for (uint_fast32_t i = first_child + 1; i < stack->count; ++i) {
+        const struct ncsh_Autocompletion_Fuzzy_Frame child = frames[i];
+        const uint_fast32_t weight = ncsh_autocompletions_candidate_weight(child.node);
+        uint_fast32_t j = i;
+        while (j > first_child && ncsh_autocompletions_candidate_weight(frames[j - 1].node) >= weight) {
+            frames[j] = frames[j - 1];
+            --j;
+        }
+        frames[j] = child;
+    }
+}
+
+// the heap holds the best results, worst first: pops them into matches back to front. returns the number of matches.
+static uint_fast32_t ncsh_autocompletions_fuzzy_matches(struct ncsh_Autocompletion_Fuzzy_Results* const results,
+                                                        struct ncsh_Autocompletion* const matches)
+{
+    const uint_fast32_t match_count = results->count;
+    for (uint_fast32_t i = match_count; i > 0; --i) {
+        matches[i - 1].value = results->entries[0].value;
+        matches[i - 1].weight = results->entries[0].weight;
+        results->entries[0] = results->entries[--results->count];
+        ncsh_autocompletions_fuzzy_sift_down(results, 0);
+    }
+    return match_count;
+}
+
+// makes rows for twice the depths there were. rows already made keep their scores, only new depths get new scores.
+static void ncsh_autocompletions_fuzzy_grow(struct ncsh_Autocompletion_Fuzzy_Rows* const rows,
+                                            const uint_fast32_t columns,
+                                            struct ncsh_Arena* const scratch_arena)
+{
+    uint_fast32_t capacity = rows->capacity ? rows->capacity * 2 : NCSH_FUZZY_ROWS;
+    if (capacity > MAX_INPUT) {
+        capacity = MAX_INPUT;
+    }
+
+    if (rows->capacity) {
+        rows->rows = arena_realloc(scratch_arena, capacity, struct ncsh_Autocompletion_Fuzzy_Row, rows->rows, rows->capacity);
+        rows->word = arena_realloc(scratch_arena, capacity, char, rows->word, rows->capacity);
+    }
+    else {
+        rows->rows = arena_malloc(scratch_arena, capacity, struct ncsh_Autocompletion_Fuzzy_Row);
+        rows->word = arena_malloc(scratch_arena, capacity, char);
+    }
+    int32_t* const scores = arena_malloc_uninitialized(scratch_arena, (size_t)(capacity - rows->capacity) * columns * 3, int32_t);
+    for (uint_fast32_t depth = rows->capacity; depth < capacity; ++depth) {
+        rows->rows[depth].matched = scores + (depth - rows->capacity) * columns * 3;
+        rows->rows[depth].bonus = rows->rows[depth].matched + columns;
+        rows->rows[depth].gap = rows->rows[depth].bonus + columns;
+    }
+    rows->capacity = capacity;
+}
+
+uint_fast32_t ncsh_autocompletions_fuzzy(const char* const query,
+                                         const size_t query_length,
+                                         struct ncsh_Autocompletion* matches,
+                                         const uint_fast32_t max_matches,
+                                         struct ncsh_Autocompletion_Node* restrict tree,
+                                         struct ncsh_Arena scratch_arena)
+{
+    if (!query || query_length < 2 || query_length > MAX_INPUT || !matches || !max_matches || !tree) {
+        return 0;
+    }
+
+    const uint_fast32_t query_characters = query_length - 1;
+    const bool ignore_case = ncsh_autocompletions_fuzzy_ignore_case(query, query_characters);
+
+    struct ncsh_Autocompletion_Fuzzy_Results results = { .capacity = max_matches };
+    results.entries = arena_malloc(&scratch_arena, max_matches, struct ncsh_Autocompletion_Fuzzy_Result);
+
+    // one row per depth. depth 0 is the root: nothing matched, no penalty yet.
+    const uint_fast32_t columns = query_characters + 1;
+    struct ncsh_Autocompletion_Fuzzy_Rows rows = {0};
+    ncsh_autocompletions_fuzzy_grow(&rows, columns, &scratch_arena);
+    for (uint_fast32_t j = 0; j < columns; ++j) {
+        rows.rows[0].matched[j] = NCSH_FUZZY_NONE;
+        rows.rows[0].bonus[j] = 0;
+        rows.rows[0].gap[j] = j ? NCSH_FUZZY_NONE : 0;
+    }
+
+    struct ncsh_Autocompletion_Fuzzy_Stack stack = { .capacity = 256 };
+    stack.frames = arena_malloc(&scratch_arena, stack.capacity, struct ncsh_Autocompletion_Fuzzy_Frame);
+    stack.frames[stack.count++] = (struct ncsh_Autocompletion_Fuzzy_Frame){ .node = tree };
+
+    const uint_fast64_t deadline = ncsh_autocompletions_clock() + NCSH_AUTOCOMPLETIONS_FUZZY_BUDGET;
+    uint_fast32_t visited = 0;
+
+    while (stack.count) {
+        if (!(++visited % NCSH_AUTOCOMPLETIONS_CLOCK_EVERY) && ncsh_autocompletions_clock() > deadline) {
+            break;
+        }
+        const struct ncsh_Autocompletion_Fuzzy_Frame frame = stack.frames[--stack.count];
+
+        // frames are at most one deeper than the deepest row, the walk goes down a depth at a time
+        if (frame.depth >= rows.capacity) {
+            ncsh_autocompletions_fuzzy_grow(&rows, columns, &scratch_arena);
+        }
+        char* const word = rows.word;
+        const struct ncsh_Autocompletion_Fuzzy_Row* const row = &rows.rows[frame.depth];
+        if (frame.depth) {
+            word[frame.depth - 1] = frame.character;
+
+            const struct ncsh_Autocompletion_Fuzzy_Row* const above = &rows.rows[frame.depth - 1];
+            const char character = frame.character;
+            const char previous = frame.depth > 1 ? word[frame.depth - 2] : ' ';
+            const char compared = ncsh_autocompletions_fuzzy_fold(character, ignore_case);
+            int32_t bonus = 0;
+            if (ncsh_autocompletions_fuzzy_is_boundary(previous)) {
+                bonus = NCSH_FUZZY_BOUNDARY;
+            }
+            else if (previous >= 'a' && previous <= 'z' && character >= 'A' && character <= 'Z') {
+                bonus = NCSH_FUZZY_CAMEL;
+            }
+
+            row->matched[0] = NCSH_FUZZY_NONE;
+            row->bonus[0] = 0;
+            row->gap[0] = 0;
+            for (uint_fast32_t j = 1; j < columns; ++j) {
+                // not matching this character: a gap, which only costs between the first and last matched characters
+                const int32_t penalty_start = j < query_characters ? NCSH_FUZZY_GAP_START : 0;
+                const int32_t penalty_extension = j < query_characters ? NCSH_FUZZY_GAP_EXTENSION : 0;
+                int32_t gap = above->gap[j] + penalty_extension;
+                if (above->matched[j] + penalty_start > gap) {
+                    gap = above->matched[j] + penalty_start;
+                }
+                row->gap[j] = gap < NCSH_FUZZY_NONE ? NCSH_FUZZY_NONE : gap;
+
+                // matching this character as query character j
+                row->matched[j] = NCSH_FUZZY_NONE;
+                row->bonus[j] = 0;
+                if (compared != query[j - 1]) {
+                    continue;
+                }
+                if (above->gap[j - 1] > NCSH_FUZZY_NONE) {
+                    row->matched[j] = above->gap[j - 1] + NCSH_FUZZY_MATCH + (j > 1 ? bonus : bonus * NCSH_FUZZY_FIRST_MULTIPLIER);
+                    row->bonus[j] = bonus;
+                }
+                if (above->matched[j - 1] > NCSH_FUZZY_NONE) {
+                    // a consecutive match keeps the bonus of the run it extends
+                    int32_t run = above->bonus[j - 1] > NCSH_FUZZY_CONSECUTIVE ? above->bonus[j - 1] : NCSH_FUZZY_CONSECUTIVE;
+                    run = bonus > run ? bonus : run;
+                    const int32_t score = above->matched[j - 1] + NCSH_FUZZY_MATCH + run;
+                    if (score > row->matched[j]) {
+                        row->matched[j] = score;
+                        row->bonus[j] = run;
+                    }
+                }
+            }
+
+            const int32_t score = row->matched[query_characters] > row->gap[query_characters] ?
+                                  row->matched[query_characters] : row->gap[query_characters];
+            if (frame.node->is_end_of_a_word && score > NCSH_FUZZY_NONE &&
+                ncsh_autocompletions_fuzzy_fits(&results, score, frame.node->weight)) {
+                ncsh_autocompletions_fuzzy_add(&results, word, frame.depth, score, frame.node->weight, &scratch_arena);
+            }
+        }
+
+        if (!frame.node->best_weight || frame.depth >= MAX_INPUT - 1) {
+            continue;
+        }
+
+        // the most any word below could score: the best state so far plus the highest bonus for every character left
+        int32_t most = NCSH_FUZZY_NONE;
+        for (uint_fast32_t j = 0; j < columns; ++j) {
+            int32_t score = row->matched[j] > row->gap[j] ? row->matched[j] : row->gap[j];
+            if (score <= NCSH_FUZZY_NONE) {
+                continue;
+            }
+            score += (int32_t)(query_characters - j) * (NCSH_FUZZY_MATCH + NCSH_FUZZY_BOUNDARY);
+            if (!j) {
+                score += NCSH_FUZZY_BOUNDARY * (NCSH_FUZZY_FIRST_MULTIPLIER - 1);
+            }
+            most = score > most ? score : most;
+        }
+        if (most <= NCSH_FUZZY_NONE || !ncsh_autocompletions_fuzzy_fits(&results, most, frame.node->best_weight)) {
+            continue;
+        }
+
+        ncsh_autocompletions_fuzzy_push(&stack, &frame, &scratch_arena);
+    }
+
+    return ncsh_autocompletions_fuzzy_matches(&results, matches);
+}
+
+/* Typo search.
+   The same walk, keeping a row of edit distances between the query and the word down to each depth instead of scores.
+   Distances are optimal string alignment, so swapping two adjacent characters is one edit like inserting, deleting or
+   changing one. A word completes what was typed, so its distance is the least distance of any of its prefixes.
+   No row of a deeper depth can go below the least distance in this row, or one more than the least in the row above,
+   through a swap, so a subtree is skipped when that bound is over max_edits or can't beat the worst result kept. */
+
+// the rows and the word down to the deepest depth reached so far.
+struct ncsh_Autocompletion_Edit_Rows {
+    uint16_t* distances; // width per depth
+    char* word;
+    uint_fast32_t capacity; // depths with a row
+};
+
+// makes rows for twice the depths there were, keeping the rows already made.
+static void ncsh_autocompletions_edits_grow(struct ncsh_Autocompletion_Edit_Rows* const rows,
+                                            const uint_fast32_t width,
+                                            struct ncsh_Arena* const scratch_arena)
+{
+    uint_fast32_t capacity = rows->capacity ? rows->capacity * 2 : NCSH_FUZZY_ROWS;
+    if (capacity > MAX_INPUT) {
+        capacity = MAX_INPUT;
+    }
+
+    if (rows->capacity) {
+        rows->distances = arena_realloc(scratch_arena, capacity * width, uint16_t, rows->distances, rows->capacity * width);
+        rows->word = arena_realloc(scratch_arena, capacity, char, rows->word, rows->capacity);
+    }
+    else {
+        rows->distances = arena_malloc(scratch_arena, capacity * width, uint16_t);
+        rows->word = arena_malloc(scratch_arena, capacity, char);
+    }
+    rows->capacity = capacity;
+}
+
+uint_fast32_t ncsh_autocompletions_edits(const char* const query,
+                                         const size_t query_length,
+                                         const uint_fast32_t max_edits,
+                                         struct ncsh_Autocompletion* matches,
+                                         const uint_fast32_t max_matches,
+                                         struct ncsh_Autocompletion_Node* restrict tree,
+                                         struct ncsh_Arena scratch_arena)
+{
+    if (!query || query_length < 2 || query_length > MAX_INPUT || !matches || !max_matches || !tree) {
+        return 0;
+    }
+
+    const uint_fast32_t query_characters = query_length - 1;
+    const bool ignore_case = ncsh_autocompletions_fuzzy_ignore_case(query, query_characters);
+
+    // results are scored by the negated distance, so the heap of fuzzy search keeps the fewest edits
+    struct ncsh_Autocompletion_Fuzzy_Results results = { .capacity = max_matches };
+    results.entries = arena_malloc(&scratch_arena, max_matches, struct ncsh_Autocompletion_Fuzzy_Result);
+
+    // a row is the distance for every number of query characters, then the least distance of a prefix down to its
+    // depth, then the least distance in the row. depth 0 is the root: every query character is still to be inserted.
+    const uint_fast32_t columns = query_characters + 1;
+    const uint_fast32_t prefix_column = columns;
+    const uint_fast32_t least_column = columns + 1;
+    const uint_fast32_t width = columns + 2;
+    struct ncsh_Autocompletion_Edit_Rows rows = {0};
+    ncsh_autocompletions_edits_grow(&rows, width, &scratch_arena);
+    for (uint_fast32_t j = 0; j < columns; ++j) {
+        rows.distances[j] = (uint16_t)j;
+    }
+    rows.distances[prefix_column] = (uint16_t)query_characters;
+    rows.distances[least_column] = 0;
+
+    struct ncsh_Autocompletion_Fuzzy_Stack stack = { .capacity = 256 };
+    stack.frames = arena_malloc(&scratch_arena, stack.capacity, struct ncsh_Autocompletion_Fuzzy_Frame);
+    stack.frames[stack.count++] = (struct ncsh_Autocompletion_Fuzzy_Frame){ .node = tree };
+
+    const uint_fast64_t deadline = ncsh_autocompletions_clock() + NCSH_AUTOCOMPLETIONS_FUZZY_BUDGET;
+    uint_fast32_t visited = 0;
+
+    while (stack.count) {
+        if (!(++visited % NCSH_AUTOCOMPLETIONS_CLOCK_EVERY) && ncsh_autocompletions_clock() > deadline) {
+            break;
+        }
+        const struct ncsh_Autocompletion_Fuzzy_Frame frame = stack.frames[--stack.count];
+
+        // frames are at most one deeper than the deepest row, the walk goes down a depth at a time
+        if (frame.depth >= rows.capacity) {
+            ncsh_autocompletions_edits_grow(&rows, width, &scratch_arena);
+        }
+        char* const word = rows.word;
+        uint16_t* const row = rows.distances + frame.depth * width;
+        uint_fast32_t bound = row[least_column];
+        if (frame.depth) {
+            word[frame.depth - 1] = frame.character;
+
+            const uint16_t* const above = row - width;
+            const char compared = ncsh_autocompletions_fuzzy_fold(frame.character, ignore_case);
+            const char previous = frame.depth > 1 ? ncsh_autocompletions_fuzzy_fold(word[frame.depth - 2], ignore_case) : '\0';
+
+            row[0] = (uint16_t)frame.depth;
+            uint16_t least = row[0];
+            for (uint_fast32_t j = 1; j < columns; ++j) {
+                uint16_t distance = above[j] + 1;
+                if (row[j - 1] + 1 < distance) {
+                    distance = row[j - 1] + 1;
+                }
+                if (above[j - 1] + (compared != query[j - 1]) < distance) {
+                    distance = above[j - 1] + (compared != query[j - 1]);
+                }
+                if (frame.depth > 1 && j > 1 && compared == query[j - 2] && previous == query[j - 1] &&
+                    (above - width)[j - 2] + 1 < distance) {
+                    distance = (above - width)[j - 2] + 1;
+                }
+                row[j] = distance;
+                least = distance < least ? distance : least;
+            }
+            row[prefix_column] = row[query_characters] < above[prefix_column] ? row[query_characters] : above[prefix_column];
+            row[least_column] = least;
+
+            const uint_fast32_t edits = row[prefix_column];
+            if (frame.node->is_end_of_a_word && edits <= max_edits &&
+                ncsh_autocompletions_fuzzy_fits(&results, -(int_fast32_t)edits, frame.node->weight)) {
+                ncsh_autocompletions_fuzzy_add(&results, word, frame.depth, -(int_fast32_t)edits, frame.node->weight,
+                                               &scratch_arena);
+            }
+
+            bound = least < above[least_column] + 1u ? least : above[least_column] + 1u;
+        }
+
+        if (!frame.node->best_weight || frame.depth >= MAX_INPUT - 1) {
+            continue;
+        }
+
+        // the fewest edits any word below could have
+        if (row[prefix_column] < bound) {
+            bound = row[prefix_column];
+        }
+        if (bound > max_edits ||
+            !ncsh_autocompletions_fuzzy_fits(&results, -(int_fast32_t)bound, frame.node->best_weight)) {
+            continue;
+        }
+
+        ncsh_autocompletions_fuzzy_push(&stack, &frame, &scratch_arena);
+    }
+
+    return ncsh_autocompletions_fuzzy_matches(&results, matches);
+}
+
+/* Per-command argument trees */
+static uint64_t ncsh_autocompletions_command_hash(const char* const command,
+                                                  const size_t length)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < length - 1; ++i) {
+        hash = (hash ^ (unsigned char)command[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+// returns the slot holding the command, or the empty slot it would go in.
+static struct ncsh_Autocompletion_Command* ncsh_autocompletions_command_slot(const struct ncsh_Autocompletion_Commands* const commands,
+                                                                             const char* const command,
+                                                                             const size_t length)
+{
+    const uint_fast32_t mask = commands->capacity - 1;
+    uint_fast32_t i = (uint_fast32_t)ncsh_autocompletions_command_hash(command, length) & mask;
+    while (commands->entries[i].command &&
+           (commands->entries[i].length != length || memcmp(commands->entries[i].command, command, length - 1))) {
+        i = (i + 1) & mask;
+    }
+    return &commands->entries[i];
+}
+
+struct ncsh_Autocompletion_Node* ncsh_autocompletions_command_add(struct ncsh_Autocompletion_Commands* const commands,
+                                                                  const char* const command,
+                                                                  const size_t length,
+                                                                  struct ncsh_Arena* const arena)
+{
+    assert(commands);
+    assert(command);
+    if (!commands || !command || length < 2 || length > MAX_INPUT || !arena) {
+        return NULL;
+    }
+
+    // keep the table at most 3/4 full, rehashing into a new one twice the size
+    if ((commands->count + 1) * 4 > commands->capacity * 3) {
+        struct ncsh_Autocompletion_Commands grown = { .capacity = commands->capacity ? commands->capacity * 2 : 16,
+                                                      .count = commands->count };
+        grown.entries = arena_malloc(arena, grown.capacity, struct ncsh_Autocompletion_Command);
+        for (uint_fast32_t i = 0; i < commands->capacity; ++i) {
+            const struct ncsh_Autocompletion_Command* const entry = &commands->entries[i];
+            if (entry->command) {
+                *ncsh_autocompletions_command_slot(&grown, entry->command, entry->length) = *entry;
+            }
+        }
+        *commands = grown;
+    }
+
+    struct ncsh_Autocompletion_Command* const slot = ncsh_autocompletions_command_slot(commands, command, length);
+    if (!slot->command) {
+        slot->command = arena_malloc_uninitialized(arena, length, char);
+        memcpy(slot->command, command, length - 1);
+        slot->command[length - 1] = '\0';
+        slot->length = length;
+        slot->arguments = ncsh_autocompletions_alloc(arena);
+        ++commands->count;
+    }
+    return slot->arguments;
+}
+
+struct ncsh_Autocompletion_Node* ncsh_autocompletions_command_search(const struct ncsh_Autocompletion_Commands* const commands,
+                                                                     const char* const command,
+                                                                     const size_t length)
+{
+    if (!commands || !commands->count || !command || length < 2) {
+        return NULL;
+    }
+    return ncsh_autocompletions_command_slot(commands, command, length)->arguments;
+}
+
+void ncsh_autocompletions_cursor_init(struct ncsh_Autocompletion_Cursor* const cursor,
+                                      struct ncsh_Autocompletion_Node* tree)
+{
+    assert(cursor);
+    cursor->node = tree;
+    cursor->root = tree;
+    cursor->depth = 0;
+    cursor->low = 0;
+    cursor->length = 0;
+    cursor->path[0] = tree;
+}
+
+bool ncsh_autocompletions_cursor_advance(struct ncsh_Autocompletion_Cursor* const cursor,
+                                         const char character)
+{
+    assert(cursor);
+    if (cursor->length >= MAX_INPUT - 1) {
+        return cursor->node;
+    }
+
+    ++cursor->length;
+    if (!cursor->node) {
+        return false;
+    }
+
+    struct ncsh_Autocompletion_Node* const node = ncsh_autocompletions_child(cursor->node, ncsh_char_to_index(character));
+    cursor->node = node;
+    if (!node) {
+        return false;
+    }
+
+    cursor->path[++cursor->depth % NCSH_AUTOCOMPLETIONS_CURSOR_PATH] = node;
+    if (cursor->depth - cursor->low >= NCSH_AUTOCOMPLETIONS_CURSOR_PATH) {
+        ++cursor->low;
+    }
+    return true;
+}
+
+void ncsh_autocompletions_cursor_rewind(struct ncsh_Autocompletion_Cursor* const cursor,
+                                        const size_t length,
+                                        const char* const prefix)
+{
+    assert(cursor);
+    if (length >= cursor->length) {
+        return;
+    }
+
+    cursor->length = length;
+    if (length > cursor->depth) {
+        return;
+    }
+    if (length >= cursor->low) {
+        cursor->depth = length;
+        cursor->node = cursor->path[length % NCSH_AUTOCOMPLETIONS_CURSOR_PATH];
+        return;
+    }
+
+    // the node fell out of the stack, every character up to it matched so walking down again finds it
+    assert(prefix);
+    ncsh_autocompletions_cursor_init(cursor, cursor->root);
+    for (size_t i = 0; i < length; ++i) {
+        ncsh_autocompletions_cursor_advance(cursor, prefix[i]);
+    }
+}
+
+uint_fast32_t ncsh_autocompletions_cursor_get(const struct ncsh_Autocompletion_Cursor* const cursor,
+                                              struct ncsh_Autocompletion* matches,
+                                              const uint_fast32_t max_matches,
+                                              struct ncsh_Arena scratch_arena)
+{
+    return ncsh_autocompletions_get_node(matches, max_matches, cursor->node, scratch_arena);
+}
+
+uint_fast8_t ncsh_autocompletions_cursor_first(const struct ncsh_Autocompletion_Cursor* const cursor,
+                                               char* match)
+{
+    return ncsh_autocompletions_first_node(match, cursor->node);
+}
+
+/* Persistent index */
+#define NCSH_AUTOCOMPLETIONS_MAGIC "ncshac\0"
+
+#ifdef NCSH_AUTOCOMPLETIONS_COMPACT
+#   define NCSH_AUTOCOMPLETIONS_LAYOUT 1
+#else
+#   define NCSH_AUTOCOMPLETIONS_LAYOUT 0
+#endif // NCSH_AUTOCOMPLETIONS_COMPACT
+
+// the image starts right after the header, so the header has to keep the root aligned
+static_assert(sizeof(struct ncsh_Autocompletions_Header) % _Alignof(struct ncsh_Autocompletion_Node) == 0,
+              "header size must keep the image aligned");
+
+// copies the subtree into arena in depth first order, each node followed by its child links and children.
+// nodes deeper than any string can reach are left out, only a damaged image has them. for an image, arena is the block
+// the image is written to and each copy gets the span of its subtree in it.
+static struct ncsh_Autocompletion_Node* ncsh_autocompletions_copy(const struct ncsh_Autocompletion_Node* const node,
+                                                                  const size_t depth,
+                                                                  const bool image,
+                                                                  struct ncsh_Arena* const arena)
+{
+    struct ncsh_Autocompletion_Node* const copy = arena_malloc_uninitialized(arena, 1, struct ncsh_Autocompletion_Node);
+    *copy = *node;
+    const int end = depth < MAX_INPUT - 1 ? NCSH_LETTERS : 0;
+
+#ifndef NCSH_AUTOCOMPLETIONS_COMPACT
+    // blocks left empty by removes are dropped
+    ptrdiff_t* blocks[NCSH_DENSE_BLOCKS];
+    for (int i = 0; i < NCSH_DENSE_BLOCKS; ++i) {
+        copy->nodes[i] = 0;
+        blocks[i] = NULL;
+        if (i * NCSH_DENSE_BLOCK < end && ncsh_autocompletions_next(node, i * NCSH_DENSE_BLOCK) < (i + 1) * NCSH_DENSE_BLOCK) {
+            blocks[i] = arena_malloc_uninitialized(arena, NCSH_DENSE_BLOCK, ptrdiff_t);
+            copy->nodes[i] = ncsh_autocompletions_offset(copy, blocks[i]);
+        }
+    }
+    for (int i = 0; i < end; ++i) {
+        if (blocks[i / NCSH_DENSE_BLOCK]) {
+            const struct ncsh_Autocompletion_Node* const child = ncsh_autocompletions_child(node, i);
+            blocks[i / NCSH_DENSE_BLOCK][i % NCSH_DENSE_BLOCK] =
+                child ? ncsh_autocompletions_offset(copy, ncsh_autocompletions_copy(child, depth + 1, image, arena)) : 0;
+        }
+    }
+#else
+    // the bitmap is written again from the children copied, a damaged image can have bits set for links left out
+    memset(copy->bitmap, 0, sizeof(copy->bitmap));
+    copy->nodes = 0;
+    copy->nodes_count = 0;
+    int count = 0;
+    for (int i = ncsh_autocompletions_next(node, 0); i < end; i = ncsh_autocompletions_next(node, i + 1)) {
+        ++count;
+    }
+    if (count) {
+        ptrdiff_t* const children = arena_malloc_uninitialized(arena, count, ptrdiff_t);
+        copy->nodes = ncsh_autocompletions_offset(copy, children);
+        for (int i = ncsh_autocompletions_next(node, 0); i < end; i = ncsh_autocompletions_next(node, i + 1)) {
+            struct ncsh_Autocompletion_Node* const child = ncsh_autocompletions_copy(ncsh_autocompletions_child(node, i), depth + 1, image, arena);
+            children[copy->nodes_count++] = ncsh_autocompletions_offset(copy, child);
+            copy->bitmap[i / 64] |= 1ULL << (i % 64);
+        }
+    }
+    copy->nodes_capacity = copy->nodes_count;
+#endif // !NCSH_AUTOCOMPLETIONS_COMPACT
+
+    copy->span = image ? (uint32_t)(arena->start - (char*)copy) : 0;
+    return copy;
+}
+
+struct ncsh_Autocompletion_Node* ncsh_autocompletions_compact(const struct ncsh_Autocompletion_Node* const tree,
+                                                              struct ncsh_Arena* const arena)
+{
+    if (!tree || !arena) {
+        return NULL;
+    }
+    return ncsh_autocompletions_copy(tree, 0, false, arena);
+}
+
+void ncsh_autocompletions_commands_compact(struct ncsh_Autocompletion_Commands* const commands,
+                                           struct ncsh_Arena* const arena)
+{
+    if (!commands || !arena) {
+        return;
+    }
+
+    // only commands with arguments left are kept, in a table sized for them
+    uint_fast32_t count = 0;
+    for (uint_fast32_t i = 0; i < commands->capacity; ++i) {
+        count += commands->entries[i].command && commands->entries[i].arguments->best_weight;
+    }
+    struct ncsh_Autocompletion_Commands compacted = {0};
+    if (count) {
+        compacted.capacity = 16;
+        while (count * 4 > compacted.capacity * 3) {
+            compacted.capacity *= 2;
+        }
+        compacted.entries = arena_malloc(arena, compacted.capacity, struct ncsh_Autocompletion_Command);
+    }
+
+    for (uint_fast32_t i = 0; i < commands->capacity; ++i) {
+        const struct ncsh_Autocompletion_Command* const entry = &commands->entries[i];
+        if (!entry->command || !entry->arguments->best_weight) {
+            continue;
+        }
+        struct ncsh_Autocompletion_Command* const slot = ncsh_autocompletions_command_slot(&compacted, entry->command, entry->length);
+        slot->command = arena_malloc_uninitialized(arena, entry->length, char);
+        memcpy(slot->command, entry->command, entry->length);
+        slot->length = entry->length;
+        slot->arguments = ncsh_autocompletions_copy(entry->arguments, 0, false, arena);
+        ++compacted.count;
+    }
+
+    *commands = compacted;
+}
+
+// bytes ncsh_autocompletions_copy writes for the subtree.
+static size_t ncsh_autocompletions_image_size(const struct ncsh_Autocompletion_Node* const node,
+                                              const size_t depth)
+{
+    size_t size = sizeof(*node);
+    if (depth >= MAX_INPUT - 1) {
+        return size;
+    }
+#ifndef NCSH_AUTOCOMPLETIONS_COMPACT
+    for (int i = 0; i < NCSH_DENSE_BLOCKS; ++i) {
+        if (ncsh_autocompletions_next(node, i * NCSH_DENSE_BLOCK) < (i + 1) * NCSH_DENSE_BLOCK) {
+            size += NCSH_DENSE_BLOCK * sizeof(ptrdiff_t);
+        }
+    }
+#endif // !NCSH_AUTOCOMPLETIONS_COMPACT
+    for (int i = ncsh_autocompletions_next(node, 0); i < NCSH_LETTERS; i = ncsh_autocompletions_next(node, i + 1)) {
+#ifdef NCSH_AUTOCOMPLETIONS_COMPACT
+        size += sizeof(ptrdiff_t);
+#endif // NCSH_AUTOCOMPLETIONS_COMPACT
+        size += ncsh_autocompletions_image_size(ncsh_autocompletions_child(node, i), depth + 1);
+    }
+    return size;
+}
+
+// the image is made of 8 byte aligned nodes and links, so its size is always a multiple of 8.
+static uint64_t ncsh_autocompletions_checksum(const void* const image,
+                                              const size_t size)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    const unsigned char* bytes = image;
+    for (size_t i = 0; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+        hash = (hash ^ word) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+static bool ncsh_autocompletions_write(const int fd,
+                                       const void* const buffer,
+                                       const size_t size)
+{
+    const char* position = buffer;
+    size_t remaining = size;
+    while (remaining) {
+        ssize_t written = write(fd, position, remaining);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        position += written;
+        remaining -= (size_t)written;
+    }
+    return true;
+}
+
+// the header and image of a tree, built in scratch_arena. NULL if the image is too big for the spans of its nodes.
+static struct ncsh_Autocompletions_Header* ncsh_autocompletions_image(struct ncsh_Autocompletion_Node* restrict tree,
+                                                                      struct ncsh_Arena* const scratch_arena)
+{
+    // the image is copied into one block sized up front, a chunked scratch arena could otherwise split it across chunks
+    const size_t image_size = ncsh_autocompletions_image_size(tree, 0);
+    if (image_size > UINT32_MAX) {
+        return NULL;
+    }
+    struct ncsh_Autocompletions_Header* const header = (struct ncsh_Autocompletions_Header*)arena_malloc_uninitialized(
+        scratch_arena, (sizeof(*header) + image_size) / sizeof(uint64_t), uint64_t);
+    struct ncsh_Arena image = {.start = (char*)(header + 1), .end = (char*)(header + 1) + image_size};
+    struct ncsh_Autocompletion_Node* const root = ncsh_autocompletions_copy(tree, 0, true, &image);
+    assert((char*)root == (char*)(header + 1) && image.start == image.end);
+
+    memcpy(header->magic, NCSH_AUTOCOMPLETIONS_MAGIC, sizeof(header->magic));
+    header->version = NCSH_AUTOCOMPLETIONS_FILE_VERSION;
+    header->layout = NCSH_AUTOCOMPLETIONS_LAYOUT;
+    header->letters = NCSH_LETTERS;
+    header->node_size = sizeof(struct ncsh_Autocompletion_Node);
+    header->image_size = image_size;
+    header->checksum = ncsh_autocompletions_checksum(root, header->image_size);
+    return header;
+}
+
+// true if the header at the start of size mapped bytes was written by a compatible build and the root's span is inside
+// the image. the rest of the image is only read, and checked, as lookups reach it.
+static bool ncsh_autocompletions_image_valid(const struct ncsh_Autocompletions_Header* const header,
+                                             const size_t size)
+{
+    const struct ncsh_Autocompletion_Node* const root = (const struct ncsh_Autocompletion_Node*)(header + 1);
+    return size >= sizeof(*header) && !memcmp(header->magic, NCSH_AUTOCOMPLETIONS_MAGIC, sizeof(header->magic)) &&
+           header->version == NCSH_AUTOCOMPLETIONS_FILE_VERSION && header->layout == NCSH_AUTOCOMPLETIONS_LAYOUT &&
+           header->letters == NCSH_LETTERS && header->node_size == sizeof(struct ncsh_Autocompletion_Node) &&
+           header->image_size >= sizeof(struct ncsh_Autocompletion_Node) &&
+           header->image_size <= size - sizeof(*header) && header->image_size <= UINT32_MAX &&
+           ncsh_autocompletions_node_valid(root, header->image_size);
+}
+
+bool ncsh_autocompletions_verify(const struct ncsh_Autocompletions_Mapping* const mapping)
+{
+    if (!mapping || !mapping->address) {
+        return false;
+    }
+    const struct ncsh_Autocompletions_Header* const header = mapping->address;
+    return ncsh_autocompletions_image_valid(header, mapping->size) &&
+           header->checksum == ncsh_autocompletions_checksum(header + 1, header->image_size);
+}
+
+// writes the header and image of tree, then trailer and extra zeroed bytes, to a temporary file moved to path.
+// unless replace is set, an existing file at path is left alone and false returned.
+static bool ncsh_autocompletions_write_image(const char* const path,
+                                             struct ncsh_Autocompletion_Node* restrict tree,
+                                             const bool replace,
+                                             const void* const trailer,
+                                             const size_t trailer_size,
+                                             const size_t extra,
+                                             struct ncsh_Arena scratch_arena)
+{
+    // named per process, sessions sharing a file can write it at the same time
+    char temp_path[PATH_MAX];
+    if (snprintf(temp_path, sizeof(temp_path), "%s.%ld.tmp", path, (long)getpid()) >= (int)sizeof(temp_path)) {
+        return false;
+    }
+
+    struct ncsh_Autocompletions_Header* const header = ncsh_autocompletions_image(tree, &scratch_arena);
+    if (!header) {
+        return false;
+    }
+    const size_t size = sizeof(*header) + header->image_size;
+
+    int fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        return false;
+    }
+    bool written = ncsh_autocompletions_write(fd, header, size) &&
+                   (!trailer_size || ncsh_autocompletions_write(fd, trailer, trailer_size)) &&
+                   (!extra || !ftruncate(fd, (off_t)(size + trailer_size + extra)));
+    if (close(fd) || !written || (replace ? rename(temp_path, path) : link(temp_path, path))) {
+        unlink(temp_path);
+        return false;
+    }
+    if (!replace) {
+        unlink(temp_path);
+    }
+
+    return true;
+}
+
+bool ncsh_autocompletions_save(const char* const path,
+                               struct ncsh_Autocompletion_Node* restrict tree,
+                               struct ncsh_Arena scratch_arena)
+{
+    if (!path || !tree) {
+        return false;
+    }
+    return ncsh_autocompletions_write_image(path, tree, true, NULL, 0, 0, scratch_arena);
+}
+
+bool ncsh_autocompletions_append(const char* const path,
+                                 struct ncsh_String* const strings,
+                                 const int count)
+{
+    if (!path || !strings || count <= 0) {
+        return false;
+    }
+
+    int fd = open(path, O_WRONLY | O_APPEND);
+    if (fd < 0) {
+        return false;
+    }
+
+    // each entry is its length without the null terminator, then its characters
+    bool written = true;
+    char entry[sizeof(uint32_t) + MAX_INPUT];
+    for (int i = 0; i < count && written; ++i) {
+        if (!strings[i].value || strings[i].length <= 1 || strings[i].length > MAX_INPUT) {
+            continue;
+        }
+        uint32_t length = (uint32_t)strings[i].length - 1;
+        memcpy(entry, &length, sizeof(length));
+        memcpy(entry + sizeof(length), strings[i].value, length);
+        written = ncsh_autocompletions_write(fd, entry, sizeof(length) + length);
+    }
+
+    return !close(fd) && written;
+}
+
+struct ncsh_Autocompletion_Node* ncsh_autocompletions_map(const char* const path,
+                                                          struct ncsh_Autocompletions_Mapping* const mapping,
+                                                          struct ncsh_Arena* const arena)
+{
+    if (!path || !mapping || !arena) {
+        return NULL;
+    }
+    mapping->address = NULL;
+    mapping->size = 0;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) || (size_t)st.st_size < sizeof(struct ncsh_Autocompletions_Header)) {
+        close(fd);
+        return NULL;
+    }
+
+    void* address = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (address == MAP_FAILED) {
+        return NULL;
+    }
+    mapping->address = address;
+    mapping->size = (size_t)st.st_size;
+
+    const struct ncsh_Autocompletions_Header* const header = address;
+    struct ncsh_Autocompletion_Node* const root = (struct ncsh_Autocompletion_Node*)(header + 1);
+    const char* const end = (char*)address + mapping->size;
+    if (!ncsh_autocompletions_image_valid(header, mapping->size)) {
+        ncsh_autocompletions_unmap(mapping);
+        return NULL;
+    }
+
+    // replay the journal, a partially written last entry is ignored
+    const char* entry = (char*)root + header->image_size;
+    uint32_t length;
+    while (end - entry >= (ptrdiff_t)sizeof(length)) {
+        memcpy(&length, entry, sizeof(length));
+        if (!length || length >= MAX_INPUT || (size_t)(end - entry) - sizeof(length) < length) {
+            break;
+        }
+        ncsh_autocompletions_add(entry + sizeof(length), length + 1, root, arena);
+        entry += sizeof(length) + length;
+    }
+
+    return root;
+}
+
+void ncsh_autocompletions_unmap(struct ncsh_Autocompletions_Mapping* const mapping)
+{
+    if (!mapping || !mapping->address) {
+        return;
+    }
+    munmap(mapping->address, mapping->size);
+    mapping->address = NULL;
+    mapping->size = 0;
+}
+
+/* Shared index */
+// follows the image. records are a 4 byte length, stored last, then the characters, padded to 4 bytes.
+struct ncsh_Autocompletions_Journal {
+    _Atomic uint64_t tail;     // bytes reserved, runs past size once the journal is full or sealed
+    _Atomic uint32_t replaced; // set once a renewed file has been renamed over this one
+    uint32_t reserved;
+    uint64_t size;             // bytes for records
+    _Atomic uint64_t folded;   // bytes of records the renewed file holds, stored before replaced
+};
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2,
+              "the journal is shared between processes, its atomics must not use locks");
+
+// the length of the record after the last one that fit, so syncing stops there instead of waiting for it
+#define NCSH_AUTOCOMPLETIONS_JOURNAL_END UINT32_MAX
+#define NCSH_AUTOCOMPLETIONS_JOURNAL_SEALED (UINT64_C(1) << 62)
+
+size_t ncsh_autocompletions_record_size(const size_t length)
+{
+    // the characters without the null terminator after their length, padded to keep the next length aligned
+    return sizeof(uint32_t) + ((length + 2) & ~(size_t)3);
+}
+
+static inline struct ncsh_Autocompletions_Journal* ncsh_autocompletions_journal(const struct ncsh_Autocompletions_Shared* const shared)
+{
+    const struct ncsh_Autocompletions_Header* const header = shared->image.address;
+    return (struct ncsh_Autocompletions_Journal*)((char*)shared->journal.address + sizeof(*header) + header->image_size);
+}
+
+static inline _Atomic uint32_t* ncsh_autocompletions_record(struct ncsh_Autocompletions_Journal* const journal,
+                                                            const uint64_t position)
+{
+    return (_Atomic uint32_t*)((char*)(journal + 1) + position);
+}
+
+static bool ncsh_autocompletions_write_shared(const char* const path,
+                                              struct ncsh_Autocompletion_Node* restrict tree,
+                                              const bool replace,
+                                              const size_t journal_size,
+                                              struct ncsh_Arena scratch_arena)
+{
+    // the records are left zeroed, the file system only stores the pages written to
+    struct ncsh_Autocompletions_Journal journal = {.size = journal_size};
+    return ncsh_autocompletions_write_image(path, tree, replace, &journal, sizeof(journal), journal_size, scratch_arena);
+}
+
+bool ncsh_autocompletions_share(const char* const path,
+                                struct ncsh_Autocompletion_Node* restrict tree,
+                                const size_t journal_size,
+                                struct ncsh_Arena scratch_arena)
+{
+    if (!path || !tree || journal_size % sizeof(uint32_t)) {
+        return false;
+    }
+    return ncsh_autocompletions_write_shared(path, tree, false, journal_size, scratch_arena);
+}
+
+struct ncsh_Autocompletion_Node* ncsh_autocompletions_attach(const char* const path,
+                                                             struct ncsh_Autocompletions_Shared* const shared,
+                                                             struct ncsh_Arena* const arena)
+{
+    if (!path || !shared || !arena) {
+        return NULL;
+    }
+    *shared = (struct ncsh_Autocompletions_Shared){.fd = -1};
+
+    int fd = open(path, O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    struct ncsh_Autocompletions_Header header;
+    if (fstat(fd, &st) || pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+        header.image_size > (uint64_t)st.st_size ||
+        (uint64_t)st.st_size - header.image_size < sizeof(header) + sizeof(struct ncsh_Autocompletions_Journal)) {
+        close(fd);
+        return NULL;
+    }
+
+    const size_t image_size = sizeof(header) + header.image_size;
+    void* image = mmap(NULL, image_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    void* journal = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    shared->image = (struct ncsh_Autocompletions_Mapping){.address = image == MAP_FAILED ? NULL : image, .size = image_size};
+    shared->journal = (struct ncsh_Autocompletions_Mapping){.address = journal == MAP_FAILED ? NULL : journal,
+                                                            .size = (size_t)st.st_size};
+    shared->fd = fd;
+    if (!shared->image.address || !shared->journal.address ||
+        !ncsh_autocompletions_image_valid(shared->image.address, image_size) ||
+        ncsh_autocompletions_journal(shared)->size != (uint64_t)st.st_size - image_size - sizeof(struct ncsh_Autocompletions_Journal)) {
+        ncsh_autocompletions_detach(shared);
+        return NULL;
+    }
+
+    struct ncsh_Autocompletion_Node* const root = (struct ncsh_Autocompletion_Node*)((char*)image + sizeof(header));
+    ncsh_autocompletions_sync(shared, root, arena);
+    return root;
+}
+
+bool ncsh_autocompletions_publish(struct ncsh_Autocompletions_Shared* const shared,
+                                  const char* const string,
+                                  const size_t length)
+{
+    if (!shared || !shared->journal.address || !string || length <= 1 || length > MAX_INPUT) {
+        return false;
+    }
+
+    struct ncsh_Autocompletions_Journal* const journal = ncsh_autocompletions_journal(shared);
+    const uint32_t characters = (uint32_t)length - 1;
+    const size_t size = ncsh_autocompletions_record_size(length);
+    const uint64_t position = atomic_fetch_add_explicit(&journal->tail, size, memory_order_relaxed);
+    if (position + size > journal->size) {
+        // only the first record that does not fit starts inside the journal
+        if (position + sizeof(uint32_t) <= journal->size) {
+            atomic_store_explicit(ncsh_autocompletions_record(journal, position), NCSH_AUTOCOMPLETIONS_JOURNAL_END,
+                                  memory_order_release);
+        }
+        return false;
+    }
+
+    _Atomic uint32_t* const record = ncsh_autocompletions_record(journal, position);
+    memcpy((char*)(record + 1), string, characters);
+    atomic_store_explicit(record, characters, memory_order_release);
+    shared->published = position + size;
+    return true;
+}
+
+const char* ncsh_autocompletions_entry(const struct ncsh_Autocompletions_Shared* const shared,
+                                       uint64_t* const position,
+                                       size_t* const length)
+{
+    if (!shared || !shared->journal.address || !position || !length) {
+        return NULL;
+    }
+
+    struct ncsh_Autocompletions_Journal* const journal = ncsh_autocompletions_journal(shared);
+    if (*position + sizeof(uint32_t) > journal->size) {
+        return NULL;
+    }
+    // an uncommitted record is 0, the entries after it are read once it is committed
+    const uint32_t characters = atomic_load_explicit(ncsh_autocompletions_record(journal, *position), memory_order_acquire);
+    const size_t size = ncsh_autocompletions_record_size((size_t)characters + 1);
+    if (!characters || characters >= MAX_INPUT || *position + size > journal->size) {
+        return NULL;
+    }
+    const char* const entry = (char*)(ncsh_autocompletions_record(journal, *position) + 1);
+    *position += size;
+    *length = characters;
+    return entry;
+}
+
+int ncsh_autocompletions_sync(struct ncsh_Autocompletions_Shared* const shared,
+                              struct ncsh_Autocompletion_Node* restrict tree,
+                              struct ncsh_Arena* const arena)
+{
+    if (!shared || !shared->journal.address || !tree || !arena) {
+        return 0;
+    }
+
+    struct ncsh_Autocompletions_Journal* const journal = ncsh_autocompletions_journal(shared);
+    int added = 0;
+    const char* entry;
+    size_t characters;
+    while ((entry = ncsh_autocompletions_entry(shared, &shared->position, &characters))) {
+        ncsh_autocompletions_add(entry, characters + 1, tree, arena);
+        ++added;
+    }
+
+    return atomic_load_explicit(&journal->replaced, memory_order_acquire) ? -1 : added;
+}
+
+// how long renewing waits for a record that was reserved but not committed, e.g. by a session that was killed
+#define NCSH_AUTOCOMPLETIONS_RENEW_WAIT 100 // milliseconds
+
+bool ncsh_autocompletions_renew(const char* const path,
+                                struct ncsh_Autocompletions_Shared* const shared,
+                                struct ncsh_Autocompletion_Node* restrict tree,
+                                const size_t journal_size,
+                                struct ncsh_Arena* const arena,
+                                struct ncsh_Arena scratch_arena)
+{
+    if (!path || !shared || !shared->journal.address || !tree || !arena) {
+        return false;
+    }
+
+    // renewing is rare and the lock keeps two sessions from renaming over each other, publishing never takes it
+    if (flock(shared->fd, LOCK_EX)) {
+        return false;
+    }
+    struct ncsh_Autocompletions_Journal* const journal = ncsh_autocompletions_journal(shared);
+    bool renewed = true;
+    if (!atomic_load_explicit(&journal->replaced, memory_order_acquire)) {
+        uint64_t end = atomic_exchange_explicit(&journal->tail, NCSH_AUTOCOMPLETIONS_JOURNAL_SEALED, memory_order_relaxed);
+        if (end > journal->size) {
+            end = journal->size;
+        }
+        for (int waited = 0; waited < NCSH_AUTOCOMPLETIONS_RENEW_WAIT; ++waited) {
+            ncsh_autocompletions_sync(shared, tree, arena);
+            if (shared->position + sizeof(uint32_t) > end ||
+                atomic_load_explicit(ncsh_autocompletions_record(journal, shared->position), memory_order_acquire) ==
+                    NCSH_AUTOCOMPLETIONS_JOURNAL_END) {
+                break;
+            }
+            nanosleep(&(struct timespec){.tv_nsec = 1000000}, NULL);
+        }
+        renewed = ncsh_autocompletions_write_shared(path, tree, true, journal_size, scratch_arena);
+        if (renewed) {
+            atomic_store_explicit(&journal->folded, shared->position, memory_order_relaxed);
+            atomic_store_explicit(&journal->replaced, 1, memory_order_release);
+        }
+    }
+    flock(shared->fd, LOCK_UN);
+    return renewed;
+}
+
+uint64_t ncsh_autocompletions_folded(const struct ncsh_Autocompletions_Shared* const shared)
+{
+    if (!shared || !shared->journal.address) {
+        return UINT64_MAX;
+    }
+    struct ncsh_Autocompletions_Journal* const journal = ncsh_autocompletions_journal(shared);
+    if (!atomic_load_explicit(&journal->replaced, memory_order_acquire)) {
+        return UINT64_MAX;
+    }
+    return atomic_load_explicit(&journal->folded, memory_order_relaxed);
+}
+
+void ncsh_autocompletions_detach(struct ncsh_Autocompletions_Shared* const shared)
+{
+    if (!shared) {
+        return;
+    }
+    ncsh_autocompletions_unmap(&shared->image);
+    ncsh_autocompletions_unmap(&shared->journal);
+    if (shared->fd >= 0) {
+        close(shared->fd);
+    }
+    shared->fd = -1;
+    shared->position = 0;
+    shared->published = 0;
 }
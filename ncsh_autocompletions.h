@@ -21,6 +21,12 @@
 #ifndef NCSH_AUTOCOMPLETIONS_H_
 #define NCSH_AUTOCOMPLETIONS_H_
 
+#include <linux/limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
 #if defined (READLINE_LIBRARY)
 #  include "ncsh_arena.h"
 #  include "ncsh_string.h"
@@ -30,31 +36,89 @@
 #endif
 
 /* NCSH_MAX_AUTOCOMPLETION_MATCHES Macro constant
- * Max number of matches a single autocompletion request can return. Used in tab autocomplete use case.
+ * Default number of matches to request from ncsh_autocompletions_get. Used in tab autocomplete use case.
+ * Callers size their own matches buffer and pass its length, so this is not a hard cap.
  */
 #ifndef NCSH_MAX_AUTOCOMPLETION_MATCHES
 #   define NCSH_MAX_AUTOCOMPLETION_MATCHES 32
 #endif // !NCSH_MAX_AUTOCOMPLETION_MATCHES
 
-#ifndef NCSH_LETTERS
-#   define NCSH_LETTERS 96 // ascii printable characters 32-127
-#endif // !NCSH_LETTERS
+/* NCSH_LETTERS Macro constant
+ * The tree is keyed on bytes, a child per byte value, so UTF-8, any other multibyte encoding and control characters
+ * round-trip unchanged. The null byte ends a string, so strings with one before their end are not added or matched.
+ */
+#define NCSH_LETTERS 256
+
+/* NCSH_AUTOCOMPLETIONS_DENSE Macro constant
+ * Build-time switch for the node layout of the prefix tree.
+ * Undefined (default): NCSH_AUTOCOMPLETIONS_COMPACT, each node holds a bitmap of the children present and a sorted
+ * array with just those children, indexed by popcount of the bitmap. Most nodes have one or two children.
+ * Defined: each node holds NCSH_DENSE_BLOCKS links to blocks of NCSH_DENSE_BLOCK child links, indexed directly by the
+ * high and low bits of the byte. Blocks are only allocated for bytes with a child, most nodes have one.
+ */
+#ifndef NCSH_AUTOCOMPLETIONS_DENSE
+#   define NCSH_AUTOCOMPLETIONS_COMPACT
+#else
+#   define NCSH_DENSE_BLOCK 16
+#   define NCSH_DENSE_BLOCKS (NCSH_LETTERS / NCSH_DENSE_BLOCK)
+#endif // !NCSH_AUTOCOMPLETIONS_DENSE
+
+/* NCSH_AUTOCOMPLETIONS_RECENT, NCSH_AUTOCOMPLETIONS_HALF_LIFE Macro constants
+ * Frecency scoring. An entry used now is worth NCSH_AUTOCOMPLETIONS_RECENT, and its worth halves every
+ * NCSH_AUTOCOMPLETIONS_HALF_LIFE seconds, down to 1. See ncsh_autocompletions_frecency and ncsh_autocompletions_decay.
+ */
+#ifndef NCSH_AUTOCOMPLETIONS_RECENT
+#   define NCSH_AUTOCOMPLETIONS_RECENT 16
+#endif // !NCSH_AUTOCOMPLETIONS_RECENT
+
+#ifndef NCSH_AUTOCOMPLETIONS_HALF_LIFE
+#   define NCSH_AUTOCOMPLETIONS_HALF_LIFE (7 * 24 * 60 * 60) // one week
+#endif // !NCSH_AUTOCOMPLETIONS_HALF_LIFE
+
+#ifdef NCSH_AUTOCOMPLETIONS_COMPACT
+#   define NCSH_BITMAP_WORDS ((NCSH_LETTERS + 63) / 64)
+#endif // NCSH_AUTOCOMPLETIONS_COMPACT
 
 // Forward Declaration: prefix tree for storing autocomplete posibilities
 struct ncsh_Autocompletion_Node;
 
 // Type Declaration: prefix tree for storing autocomplete possibilities
+// Children are linked by byte offsets from the node holding the link rather than by pointers, so a tree can be written
+// out and mapped back in at any address (see ncsh_autocompletions_save and ncsh_autocompletions_map).
+// weight is the total weight of the words at and below the node, so the weight of the words ending at the node is its
+// weight minus the weights of its children.
+// best_weight and best_index cache the highest weighted word strictly below the node (best_weight is 0 if there is none)
+// and the child it is reached through, so the best match under any prefix can be read off without visiting the subtree.
+// span is the bytes a node read from a file takes up with its subtree, links out of it are checked against it when they
+// are followed. it is 0 for nodes built in memory, and once a node read from a file has its links changed.
+#ifndef NCSH_AUTOCOMPLETIONS_COMPACT
+struct ncsh_Autocompletion_Node {
+    uint32_t weight;
+    uint32_t best_weight;
+    uint8_t best_index;
+    bool is_end_of_a_word;
+    uint32_t span;
+    ptrdiff_t nodes[NCSH_DENSE_BLOCKS]; // offsets of the blocks of child links, each link relative to the node
+};
+#else
 struct ncsh_Autocompletion_Node {
+    uint32_t weight;
+    uint32_t best_weight;
+    uint8_t best_index;
+    uint8_t nodes_count;    // a child can't be the null byte, so there are at most NCSH_LETTERS - 1
+    uint8_t nodes_capacity;
     bool is_end_of_a_word;
-    uint_fast8_t weight;
-    struct ncsh_Autocompletion_Node* nodes[NCSH_LETTERS];
+    uint32_t span;
+    uint64_t bitmap[NCSH_BITMAP_WORDS];
+    ptrdiff_t nodes; // offset of the array of nodes_count child links, ordered by index
 };
+#endif // !NCSH_AUTOCOMPLETIONS_COMPACT
 
 /* Typedef to keep consistent with readline style */
 typedef struct ncsh_Autocompletion_Node Autocompletion_Node;
 
 struct ncsh_Autocompletion {
-    uint_fast8_t weight;
+    uint_fast32_t weight;
     char* value;
 };
 
@@ -63,11 +127,11 @@ typedef struct ncsh_Autocompletion Autocompletion;
 
 inline int ncsh_char_to_index(const char character)
 {
-    return (int)character - ' ';
+    return (int)(unsigned char)character;
 }
 inline char ncsh_index_to_char(const int index)
 {
-    return (char)index + ' ';
+    return (char)(unsigned char)index;
 }
 
 struct ncsh_Autocompletion_Node* ncsh_autocompletions_alloc(struct ncsh_Arena* const arena);
@@ -77,11 +141,69 @@ void ncsh_autocompletions_add(const char* const string,
                               struct ncsh_Autocompletion_Node* tree,
                               struct ncsh_Arena* const arena);
 
+// adds the string with the given weight instead of 1, e.g. a weight from ncsh_autocompletions_frecency.
+// weights saturate at UINT32_MAX, only ncsh_autocompletions_decay ages them.
+void ncsh_autocompletions_add_weighted(const char* const string,
+                                       const size_t length,
+                                       uint_fast32_t weight,
+                                       struct ncsh_Autocompletion_Node* tree,
+                                       struct ncsh_Arena* const arena);
+
+// takes up to weight off the string, e.g. when the history entry it was added for is evicted.
+// once nothing is left of it, the string is no longer matched, and nodes left with no weight are unlinked.
+// returns false if the string is not in the tree.
+bool ncsh_autocompletions_decrement(const char* const string,
+                                    const size_t length,
+                                    uint_fast32_t weight,
+                                    struct ncsh_Autocompletion_Node* tree);
+
+// takes the string out of the tree whatever its weight, unlinking the nodes only it used.
+// returns the weight it had, 0 if it is not in the tree.
+uint_fast32_t ncsh_autocompletions_remove(const char* const string,
+                                          const size_t length,
+                                          struct ncsh_Autocompletion_Node* tree);
+
+// copies the words left in the tree to arena, without the nodes unlinked by ncsh_autocompletions_decrement, _remove
+// and _decay or the unused room in child arrays, and returns the copy. laid out depth first like
+// ncsh_autocompletions_load lays out a tree. once nothing uses the old tree, the arena it was in can be freed,
+// so a long running shell can keep the memory for its tree bounded by compacting into a new arena now and then.
+struct ncsh_Autocompletion_Node* ncsh_autocompletions_compact(const struct ncsh_Autocompletion_Node* tree,
+                                                              struct ncsh_Arena* const arena);
+
+// adds every word of source to destination with the weight it has in source, e.g. to carry words added to a tree
+// over to its replacement.
+void ncsh_autocompletions_merge(struct ncsh_Autocompletion_Node* destination,
+                                const struct ncsh_Autocompletion_Node* source,
+                                struct ncsh_Arena* const arena);
+
+// halves the weight of every word in the tree, dropping the words that reach 0. calling this once every
+// NCSH_AUTOCOMPLETIONS_HALF_LIFE ages words added with ncsh_autocompletions_add the same way as frecency weights.
+void ncsh_autocompletions_decay(struct ncsh_Autocompletion_Node* tree);
+
+// returns the number of nodes reachable from tree, tree included. nodes unlinked by ncsh_autocompletions_decrement,
+// _remove and _decay aren't counted, though they stay in the arena until it is compacted.
+size_t ncsh_autocompletions_count(const struct ncsh_Autocompletion_Node* tree);
+
+// returns the weight for an entry last used at used_time: NCSH_AUTOCOMPLETIONS_RECENT if it was used at now,
+// halved for every NCSH_AUTOCOMPLETIONS_HALF_LIFE since, but at least 1.
+uint_fast16_t ncsh_autocompletions_frecency(const time_t used_time,
+                                            const time_t now);
+
 void ncsh_autocompletions_add_multiple(struct ncsh_String* const strings,
                                        const int count,
                                        struct ncsh_Autocompletion_Node* tree,
                                        struct ncsh_Arena* const arena);
 
+// builds a new tree of the strings in one pass, with the same words and weights as ncsh_autocompletions_add_multiple on
+// an empty tree, or as adding each string with weights[i] when weights is not NULL.
+// the strings are sorted and their duplicates merged in scratch_arena, then each node is written once, followed by its
+// subtree, so the tree is contiguous in arena in depth first order, the same layout ncsh_autocompletions_save writes.
+struct ncsh_Autocompletion_Node* ncsh_autocompletions_load(const struct ncsh_String* const strings,
+                                                           const uint_fast32_t* const weights,
+                                                           const int count,
+                                                           struct ncsh_Arena* const arena,
+                                                           struct ncsh_Arena scratch_arena);
+
 struct ncsh_Autocompletion_Node* ncsh_autocompletions_search(const char* const string,
                                                              const size_t length,
                                                              struct ncsh_Autocompletion_Node* tree);
@@ -89,20 +211,313 @@ struct ncsh_Autocompletion_Node* ncsh_autocompletions_search(const char* const s
 struct ncsh_Autocompletion_Node* ncsh_autocompletions_search_string(const struct ncsh_String string,
                                                                     struct ncsh_Autocompletion_Node* tree);
 
-// gets all matches based on traversing the tree.
+// gets the max_matches highest weighted matches, highest weight first, with a best-first traversal over the cached
+// subtree weights. only as much of the subtree is visited as is needed to find them.
 // populates matches into variable matches and returns 0 if no matches, number of matches length if any matches.
-uint_fast8_t ncsh_autocompletions_get(const char* const search,
-                                      const size_t search_length,
-                                      struct ncsh_Autocompletion* matches,
-                                      struct ncsh_Autocompletion_Node* tree,
-                                      struct ncsh_Arena scratch_arena);
+// match values are allocated from scratch_arena.
+uint_fast32_t ncsh_autocompletions_get(const char* const search,
+                                       const size_t search_length,
+                                       struct ncsh_Autocompletion* matches,
+                                       const uint_fast32_t max_matches,
+                                       struct ncsh_Autocompletion_Node* tree,
+                                       struct ncsh_Arena scratch_arena);
 
-// gets highest weighted match based on traversing the tree.
+// same as ncsh_autocompletions_get, but stops after budget microseconds. the matches found by then are the highest
+// weighted ones, in order. sets complete to false when the budget ran out before max_matches or the subtree did.
+uint_fast32_t ncsh_autocompletions_get_budgeted(const char* const search,
+                                                const size_t search_length,
+                                                struct ncsh_Autocompletion* matches,
+                                                const uint_fast32_t max_matches,
+                                                const uint_fast32_t budget,
+                                                bool* const complete,
+                                                struct ncsh_Autocompletion_Node* tree,
+                                                struct ncsh_Arena scratch_arena);
+
+// gets highest weighted match by following the cached best child of each node, O(search length + match length).
 // populates match into variable match and returns 0 if not matches, 1 if any matches.
 uint_fast8_t ncsh_autocompletions_first(const char* const search,
                                         const size_t search_length,
                                         char* match,
-                                        struct ncsh_Autocompletion_Node* tree,
-                                        struct ncsh_Arena scratch_arena);
+                                        struct ncsh_Autocompletion_Node* tree);
+
+// same as ncsh_autocompletions_get and ncsh_autocompletions_first, for a node already found with
+// ncsh_autocompletions_search. lets callers that cache search results skip walking the prefix again.
+uint_fast32_t ncsh_autocompletions_get_node(struct ncsh_Autocompletion* matches,
+                                            const uint_fast32_t max_matches,
+                                            struct ncsh_Autocompletion_Node* search_result,
+                                            struct ncsh_Arena scratch_arena);
+
+uint_fast8_t ncsh_autocompletions_first_node(char* match,
+                                             struct ncsh_Autocompletion_Node* search_result);
+
+/* Packed matches.
+ * ncsh_autocompletions_get_packed gets the same matches as ncsh_autocompletions_get, but writes their values back to back
+ * into a buffer provided by the caller instead of allocating each one from the scratch arena, which then only holds the
+ * traversal. Values are what follows the search string, so the search string is not repeated, and each value only
+ * writes what follows the longest prefix it shares with an earlier match: the first prefix characters of the value are
+ * those of match parent, and buffer + offset holds the rest, null terminated. length counts the whole value and the
+ * null terminator. ncsh_autocompletions_span_value puts a value back together.
+ * Matches stop at the first one that doesn't fit in the buffer, max_matches * MAX_INPUT bytes always fits them all.
+ */
+struct ncsh_Autocompletion_Span {
+    uint32_t offset;
+    uint32_t weight;
+    uint32_t parent; // only meaningful when prefix isn't 0
+    uint16_t length;
+    uint16_t prefix;
+};
+
+/* I don't use typedefs in most of my projects, but use here to keep consistent with readline style */
+typedef struct ncsh_Autocompletion_Span Autocompletion_Span;
+
+uint_fast32_t ncsh_autocompletions_get_packed(const char* const search,
+                                              const size_t search_length,
+                                              struct ncsh_Autocompletion_Span* matches,
+                                              const uint_fast32_t max_matches,
+                                              char* buffer,
+                                              const size_t buffer_size,
+                                              struct ncsh_Autocompletion_Node* tree,
+                                              struct ncsh_Arena scratch_arena);
+
+uint_fast32_t ncsh_autocompletions_get_node_packed(struct ncsh_Autocompletion_Span* matches,
+                                                   const uint_fast32_t max_matches,
+                                                   char* buffer,
+                                                   const size_t buffer_size,
+                                                   struct ncsh_Autocompletion_Node* search_result,
+                                                   struct ncsh_Arena scratch_arena);
+
+// writes the value of matches[index] to value, which needs room for matches[index].length bytes.
+void ncsh_autocompletions_span_value(const struct ncsh_Autocompletion_Span* const matches,
+                                     const uint_fast32_t index,
+                                     const char* const buffer,
+                                     char* const value);
+
+/* NCSH_AUTOCOMPLETIONS_FUZZY_BUDGET Macro constant
+ * Most microseconds ncsh_autocompletions_fuzzy and ncsh_autocompletions_edits spend per call, so a keystroke stays
+ * interactive however large the tree is. When the budget runs out the best matches found so far are returned.
+ */
+#ifndef NCSH_AUTOCOMPLETIONS_FUZZY_BUDGET
+#   define NCSH_AUTOCOMPLETIONS_FUZZY_BUDGET 2000
+#endif // !NCSH_AUTOCOMPLETIONS_FUZZY_BUDGET
+
+// gets the max_matches best words containing the characters of query in order, not necessarily adjacent.
+// words are scored like fzf: matched characters score, more so at the start of a word and when consecutive, and gaps
+// between them cost. ties go to the higher weight. unlike ncsh_autocompletions_get, match values are whole words.
+// a query of all lowercase matches either case. match values are allocated from scratch_arena.
+uint_fast32_t ncsh_autocompletions_fuzzy(const char* const query,
+                                         const size_t query_length,
+                                         struct ncsh_Autocompletion* matches,
+                                         const uint_fast32_t max_matches,
+                                         struct ncsh_Autocompletion_Node* tree,
+                                         struct ncsh_Arena scratch_arena);
+
+// gets the max_matches best words that start with a prefix within max_edits edits of query, so a query with a typo
+// still completes. an edit inserts, deletes or changes a character, or swaps two adjacent ones. fewer edits rank first,
+// then higher weight. match values are whole words allocated from scratch_arena, case is smart like fuzzy search.
+uint_fast32_t ncsh_autocompletions_edits(const char* const query,
+                                         const size_t query_length,
+                                         const uint_fast32_t max_edits,
+                                         struct ncsh_Autocompletion* matches,
+                                         const uint_fast32_t max_matches,
+                                         struct ncsh_Autocompletion_Node* tree,
+                                         struct ncsh_Arena scratch_arena);
+
+/* Per-command argument trees.
+ * Maps a command word to a tree of the arguments it was run with, so suggestions for an argument only come from what
+ * was typed after that command. A zero initialized struct is an empty index, entries are allocated from the arena.
+ */
+struct ncsh_Autocompletion_Command {
+    char* command;
+    size_t length; // including the null terminator
+    struct ncsh_Autocompletion_Node* arguments;
+};
+
+struct ncsh_Autocompletion_Commands {
+    struct ncsh_Autocompletion_Command* entries; // open addressing, capacity is 0 or a power of 2
+    uint_fast32_t count;
+    uint_fast32_t capacity;
+};
+
+/* I don't use typedefs in most of my projects, but use here to keep consistent with readline style */
+typedef struct ncsh_Autocompletion_Commands Autocompletion_Commands;
+
+// returns the argument tree for the command, adding an empty one if the command has none yet.
+struct ncsh_Autocompletion_Node* ncsh_autocompletions_command_add(struct ncsh_Autocompletion_Commands* const commands,
+                                                                  const char* const command,
+                                                                  const size_t length,
+                                                                  struct ncsh_Arena* const arena);
+
+// returns the argument tree for the command, or NULL if it has none.
+struct ncsh_Autocompletion_Node* ncsh_autocompletions_command_search(const struct ncsh_Autocompletion_Commands* const commands,
+                                                                     const char* const command,
+                                                                     const size_t length);
+
+// replaces the index with a copy in arena made with ncsh_autocompletions_compact, leaving out commands with no arguments left.
+void ncsh_autocompletions_commands_compact(struct ncsh_Autocompletion_Commands* const commands,
+                                           struct ncsh_Arena* const arena);
+
+/* Incremental prefix search.
+ * A cursor is the search state for a prefix typed so far: advancing it by a character is one step down the tree,
+ * and rewinding it is a lookup in the stack of nodes it passed through, so per-keystroke cost does not depend on
+ * the prefix length. The stack only keeps the last NCSH_AUTOCOMPLETIONS_CURSOR_PATH nodes, rewinding further back
+ * than that walks the prefix down from the root again. Characters advanced past the point the prefix stops matching
+ * are counted, so rewinding over them leaves the cursor without a match until it is back at a prefix that has one.
+ * ncsh_autocompletions_decrement and ncsh_autocompletions_decay can unlink nodes, so start cursors over after them.
+ */
+#define NCSH_AUTOCOMPLETIONS_CURSOR_PATH 32
+
+struct ncsh_Autocompletion_Cursor {
+    struct ncsh_Autocompletion_Node* node; // node for the prefix, NULL if the prefix has no match
+    struct ncsh_Autocompletion_Node* root;
+    size_t depth;                          // characters matched, path[depth % size] == node when node is not NULL
+    size_t low;                            // shallowest depth still in path
+    size_t length;                         // characters advanced, >= depth
+    struct ncsh_Autocompletion_Node* path[NCSH_AUTOCOMPLETIONS_CURSOR_PATH]; // the last nodes matched
+};
+
+/* I don't use typedefs in most of my projects, but use here to keep consistent with readline style */
+typedef struct ncsh_Autocompletion_Cursor Autocompletion_Cursor;
+
+void ncsh_autocompletions_cursor_init(struct ncsh_Autocompletion_Cursor* const cursor,
+                                      struct ncsh_Autocompletion_Node* tree);
+
+// returns true if the prefix still has a match.
+bool ncsh_autocompletions_cursor_advance(struct ncsh_Autocompletion_Cursor* const cursor,
+                                         const char character);
+
+// moves the cursor back to the first length characters of its prefix.
+// prefix holds them, it is only read when they are further back than the cursor keeps.
+void ncsh_autocompletions_cursor_rewind(struct ncsh_Autocompletion_Cursor* const cursor,
+                                        const size_t length,
+                                        const char* const prefix);
+
+uint_fast32_t ncsh_autocompletions_cursor_get(const struct ncsh_Autocompletion_Cursor* const cursor,
+                                              struct ncsh_Autocompletion* matches,
+                                              const uint_fast32_t max_matches,
+                                              struct ncsh_Arena scratch_arena);
+
+uint_fast8_t ncsh_autocompletions_cursor_first(const struct ncsh_Autocompletion_Cursor* const cursor,
+                                               char* match);
+
+/* Persistent index.
+ * ncsh_autocompletions_save writes a tree to a file as a flat image: a versioned header followed by the nodes in
+ * depth first order, linked by the same offsets they use in memory. ncsh_autocompletions_map maps the file and returns
+ * the image's root, which every function above works on in place, so startup does not rebuild the tree.
+ * The mapping is private: adding to a mapped tree copies only the pages it touches and never changes the file.
+ * Entries added since the last save can be appended to the file's journal with ncsh_autocompletions_append; mapping
+ * the file replays them into the tree, and saving again folds them into the image.
+ * Mapping only checks the header, so startup touches no more of the image than the first lookups do. Every link is
+ * checked when it is followed instead, so a damaged or forged image can only lose words, never send a lookup outside
+ * of it. ncsh_autocompletions_verify checks the whole image against its checksum, for callers that can afford to.
+ */
+#define NCSH_AUTOCOMPLETIONS_FILE_VERSION 5
+
+struct ncsh_Autocompletions_Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t layout;     // 1 if written with the compact node layout, 0 for dense
+    uint32_t letters;    // NCSH_LETTERS
+    uint32_t node_size;  // sizeof(struct ncsh_Autocompletion_Node)
+    uint64_t image_size; // bytes of nodes after the header, the journal follows them
+    uint64_t checksum;   // FNV-1a over the image, 8 bytes at a time
+};
+
+struct ncsh_Autocompletions_Mapping {
+    void* address;
+    size_t size;
+};
+
+// returns true if the tree was written. the image is built in scratch_arena, then renamed over path.
+// trees over 4GB can't be written.
+bool ncsh_autocompletions_save(const char* const path,
+                               struct ncsh_Autocompletion_Node* tree,
+                               struct ncsh_Arena scratch_arena);
+
+// returns true if the strings were appended to the journal of a file written by ncsh_autocompletions_save.
+bool ncsh_autocompletions_append(const char* const path,
+                                 struct ncsh_String* const strings,
+                                 const int count);
+
+// returns the root of the mapped tree, or NULL if the file is missing, its header is corrupt, or it was written by an
+// incompatible build. journal entries are added to the tree with nodes allocated from arena.
+struct ncsh_Autocompletion_Node* ncsh_autocompletions_map(const char* const path,
+                                                          struct ncsh_Autocompletions_Mapping* const mapping,
+                                                          struct ncsh_Arena* const arena);
+
+// returns true if the image in the mapping matches the checksum it was written with. reads every page of it.
+bool ncsh_autocompletions_verify(const struct ncsh_Autocompletions_Mapping* const mapping);
+
+void ncsh_autocompletions_unmap(struct ncsh_Autocompletions_Mapping* const mapping);
+
+/* Shared index.
+ * ncsh_autocompletions_share writes a tree like ncsh_autocompletions_save, followed by a journal of journal_size bytes
+ * that concurrent sessions append to in place. Put it in a memory backed directory such as $XDG_RUNTIME_DIR.
+ * ncsh_autocompletions_attach maps the image privately, so its pages are shared by every session attached to the file
+ * until one of them changes a page, and maps the journal shared.
+ * ncsh_autocompletions_publish reserves room in the journal with an atomic add to its tail and commits the entry by
+ * storing its length last, so sessions publish without locks and without waiting for each other.
+ * ncsh_autocompletions_sync adds the entries committed since the last sync, by any session, to the tree.
+ * When the journal is full, ncsh_autocompletions_renew seals it and writes the file again with the journal folded into
+ * the image, and every session attaches to the new file.
+ */
+struct ncsh_Autocompletions_Shared {
+    struct ncsh_Autocompletions_Mapping image;   // private mapping of the header and image
+    struct ncsh_Autocompletions_Mapping journal; // shared mapping of the whole file
+    uint64_t position;                           // journal bytes added to the tree so far
+    uint64_t published;                          // journal bytes up to the end of the last record published here
+    int fd;                                      // locked while renewing
+};
+
+// returns true if the file was written, false if it could not be or path already exists.
+bool ncsh_autocompletions_share(const char* const path,
+                                struct ncsh_Autocompletion_Node* tree,
+                                const size_t journal_size,
+                                struct ncsh_Arena scratch_arena);
+
+// returns the root of the mapped tree with the committed journal entries added, or NULL if the file is missing, its
+// header is corrupt, or it was written by an incompatible build.
+struct ncsh_Autocompletion_Node* ncsh_autocompletions_attach(const char* const path,
+                                                             struct ncsh_Autocompletions_Shared* const shared,
+                                                             struct ncsh_Arena* const arena);
+
+// returns false if the journal is full or sealed, see ncsh_autocompletions_renew.
+bool ncsh_autocompletions_publish(struct ncsh_Autocompletions_Shared* const shared,
+                                  const char* const string,
+                                  const size_t length);
+
+// returns the journal bytes publishing a string of length, counting the null terminator, takes. strings whose record
+// is bigger than the journal can never be published.
+size_t ncsh_autocompletions_record_size(const size_t length);
+
+// returns the committed journal entry at *position and moves *position past it, or NULL if the entry there isn't
+// committed yet. the characters are not null terminated, length counts them only.
+const char* ncsh_autocompletions_entry(const struct ncsh_Autocompletions_Shared* const shared,
+                                       uint64_t* const position,
+                                       size_t* const length);
+
+// returns the number of entries added to tree, or -1 once the file has been renewed and the caller should attach to
+// it again. the entries committed before it was renewed have been added either way.
+int ncsh_autocompletions_sync(struct ncsh_Autocompletions_Shared* const shared,
+                              struct ncsh_Autocompletion_Node* tree,
+                              struct ncsh_Arena* const arena);
+
+// seals the journal, waits for the entries being published to be committed and syncs them into tree, then writes tree
+// to path with an empty journal. if another session renewed the file first, only waits for it. either way, the caller
+// attaches to path again afterwards. returns false if the file could not be written.
+// a record that is still not committed after NCSH_AUTOCOMPLETIONS_RENEW_WAIT stops the folding, and it and the records
+// after it are left out of the new file: see ncsh_autocompletions_folded.
+bool ncsh_autocompletions_renew(const char* const path,
+                                struct ncsh_Autocompletions_Shared* const shared,
+                                struct ncsh_Autocompletion_Node* tree,
+                                const size_t journal_size,
+                                struct ncsh_Arena* const arena,
+                                struct ncsh_Arena scratch_arena);
+
+// returns the journal bytes the file that replaced this one was written with. a record this session published that ends
+// past them, see published, is not in the new file and has to be published to it again. returns UINT64_MAX while the
+// file has not been replaced.
+uint64_t ncsh_autocompletions_folded(const struct ncsh_Autocompletions_Shared* const shared);
+
+void ncsh_autocompletions_detach(struct ncsh_Autocompletions_Shared* const shared);
 
 #endif /* !NCSH_AUTOCOMPLETIONS_H_ */
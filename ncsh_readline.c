@@ -21,6 +21,1482 @@
 
 #include "ncsh_readline.h"
 
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#if defined (__linux__)
+#  include <sys/inotify.h>
+#endif
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static void ncsh_build_record (const char *, int, uint_fast32_t);
+
+/* Inline suggestions.  After each command, the line is looked up in the
+   autocompletion tree and the rest of the best match is drawn dimmed past
+   the cursor (see _rl_suggestion in display.c).  The search is kept in a
+   cursor, so each keystroke only rewinds it to the first position changed
+   since the last one (_rl_line_damage, which rl_insert_text and
+   rl_delete_text lower) and advances it over what is new, instead of
+   searching from the root or comparing the whole line.
+   When no earlier line starts the same way and the input has argument
+   trees per command, the word being typed is looked up in the tree of
+   arguments its command was run with instead, wherever they appeared. */
+static struct
+{
+  Autocompletion_Node *tree;	/* tree the cursor was started on */
+  Autocompletion_Cursor cursor;
+  int has_suggestion;
+  char suggestion[MAX_INPUT];
+} ncsh_suggestion;
+
+static void
+ncsh_suggestion_reset (Autocompletion_Node *tree)
+{
+  ncsh_suggestion.tree = tree;
+  ncsh_suggestion.has_suggestion = 0;
+  if (tree)
+    ncsh_autocompletions_cursor_init (&ncsh_suggestion.cursor, tree);
+}
+
+/* Words made only of these characters separate one command from the next. */
+static int
+ncsh_command_separator (const char *word)
+{
+  return (*word && word[strspn (word, "|&;()")] == '\0');
+}
+
+static void
+ncsh_free_words (char **words)
+{
+  size_t i;
+
+  for (i = 0; words[i]; i++)
+    xfree (words[i]);
+  xfree (words);
+}
+
+/* Words of the line, split with the same rules history expansion uses.
+   A word followed by whitespace can't change while the line up to that
+   whitespace doesn't, so those are kept across keys and only the rest of
+   the line after the last one is split again. */
+struct ncsh_word
+{
+  int start, end;
+  size_t next;		/* index of the first word of the command after it */
+};
+
+static struct
+{
+  struct ncsh_word *words;
+  size_t count, size;
+} ncsh_words;
+
+/* The line changed from POS on: forget the words that ran up to there. */
+static void
+ncsh_words_damage (int pos)
+{
+  while (ncsh_words.count && ncsh_words.words[ncsh_words.count - 1].end >= pos)
+    ncsh_words.count--;
+}
+
+/* Split rl_line_buffer up to END.  Return how many words the command END
+   is in has so far, with its first word in COMMAND and its last in LAST. */
+static size_t
+ncsh_words_split (int end, struct ncsh_word *command, struct ncsh_word *last)
+{
+  char *line, **tail;
+  size_t i, kept, count, first;
+  int pos;
+  struct ncsh_word word;
+
+  if (_rl_line_damage >= 0)
+    ncsh_words_damage (_rl_line_damage);
+
+  /* TAB splits up to the word being completed, which can be before words
+     kept for the whole line. */
+  for (kept = ncsh_words.count; kept && ncsh_words.words[kept - 1].end >= end; kept--)
+    ;
+  first = kept ? ncsh_words.words[kept - 1].next : 0;
+  if (kept)
+    *last = ncsh_words.words[kept - 1];
+  pos = kept ? ncsh_words.words[kept - 1].end : 0;
+  if (pos >= end)
+    tail = (char **)NULL;
+  else if (end == rl_end)
+    tail = history_tokenize (rl_line_buffer + pos);
+  else
+    {
+      line = (char *)xmalloc (end - pos + 1);
+      memcpy (line, rl_line_buffer + pos, end - pos);
+      line[end - pos] = '\0';
+      tail = history_tokenize (line);
+      xfree (line);
+    }
+
+  for (i = 0, count = kept; tail && tail[i]; i++, count++)
+    {
+      while (whitespace (rl_line_buffer[pos]) || rl_line_buffer[pos] == '\n')
+	pos++;
+      word.start = pos;
+      pos += strlen (tail[i]);
+      word.end = pos;
+      word.next = ncsh_command_separator (tail[i]) ? count + 1 : first;
+      first = word.next;
+      *last = word;
+      if (first == count)
+	*command = word;
+
+      if (count == ncsh_words.count && pos < end && whitespace (rl_line_buffer[pos]))
+	{
+	  if (ncsh_words.count == ncsh_words.size)
+	    {
+	      ncsh_words.size = ncsh_words.size ? ncsh_words.size * 2 : 16;
+	      ncsh_words.words = (struct ncsh_word *)xrealloc (ncsh_words.words, ncsh_words.size * sizeof (struct ncsh_word));
+	    }
+	  ncsh_words.words[ncsh_words.count++] = word;
+	}
+    }
+  if (tail)
+    ncsh_free_words (tail);
+
+  if (first < kept)
+    *command = ncsh_words.words[first];
+  return (count - first);
+}
+
+/* Suggest the rest of the word being typed from the argument tree of the
+   command it belongs to. */
+static int
+ncsh_argument_suggestion (Autocompletion_Commands *commands, char *suggestion)
+{
+  struct ncsh_word command, current;
+  Autocompletion_Node *tree;
+
+  /* Both lookups go by length, so the words are searched in place. */
+  if (rl_end == 0 || whitespace (rl_line_buffer[rl_end - 1]) || ncsh_words_split (rl_end, &command, &current) < 2 ||
+      (tree = ncsh_autocompletions_command_search (commands, rl_line_buffer + command.start, command.end - command.start + 1)) == 0)
+    return 0;
+  return (ncsh_autocompletions_first_node (suggestion, ncsh_autocompletions_search (rl_line_buffer + current.start, current.end - current.start + 1, tree)));
+}
+
+static void
+ncsh_suggestion_update (readline_input *input)
+{
+  size_t same;
+
+  ncsh_suggestion.has_suggestion = 0;
+  if (input->tree == 0 || rl_done || rl_end == 0 || rl_point != rl_end || rl_end >= MAX_INPUT)
+    return;
+
+  if (ncsh_suggestion.tree != input->tree)
+    ncsh_suggestion_reset (input->tree);
+
+  /* The line is unchanged before the lowest damage since the last update,
+     so the cursor is still good up to there. */
+  same = ncsh_suggestion.cursor.length;
+  if (_rl_line_damage >= 0 && (size_t)_rl_line_damage < same)
+    same = _rl_line_damage;
+  if (same > (size_t)rl_end)
+    same = rl_end;
+  if (_rl_line_damage >= 0)
+    ncsh_words_damage (_rl_line_damage);
+  _rl_line_damage = -1;
+
+  ncsh_autocompletions_cursor_rewind (&ncsh_suggestion.cursor, same, rl_line_buffer);
+  for (; same < (size_t)rl_end; same++)
+    ncsh_autocompletions_cursor_advance (&ncsh_suggestion.cursor, rl_line_buffer[same]);
+
+  ncsh_suggestion.has_suggestion = ncsh_autocompletions_cursor_first (&ncsh_suggestion.cursor, ncsh_suggestion.suggestion);
+  if (ncsh_suggestion.has_suggestion == 0 && input->commands && input->commands->count)
+    ncsh_suggestion.has_suggestion = ncsh_argument_suggestion (input->commands, ncsh_suggestion.suggestion);
+
+  /* The tree keeps control characters, such as the TAB or newline of a
+     pasted line.  The suggestion is not drawn past one, so it is not
+     accepted past one either. */
+  if (ncsh_suggestion.has_suggestion)
+    {
+      char *s;
+
+      for (s = ncsh_suggestion.suggestion; *s; s++)
+	if (CTRL_CHAR (*s) || *s == RUBOUT)
+	  break;
+      *s = '\0';
+      ncsh_suggestion.has_suggestion = s != ncsh_suggestion.suggestion;
+    }
+
+#if defined (HANDLE_MULTIBYTE)
+  /* The tree is keyed on bytes, so cut the suggestion after its last
+     complete character in the current locale.  Accepting it should never
+     leave a partial character on the line. */
+  if (ncsh_suggestion.has_suggestion && MB_CUR_MAX > 1 && rl_byte_oriented == 0)
+    {
+      mbstate_t ps;
+      char *s;
+      int len;
+
+      memset (&ps, 0, sizeof (mbstate_t));
+      for (s = ncsh_suggestion.suggestion; *s; s += len)
+	if ((len = _rl_get_char_len (s, &ps)) <= 0)
+	  break;
+      *s = '\0';
+      ncsh_suggestion.has_suggestion = s != ncsh_suggestion.suggestion;
+    }
+#endif
+}
+
+/* Bindable command: insert the rest of the suggestion at the end of the
+   line.  Without a suggestion, move forward a character like forward-char,
+   so it can take over the keys forward-char is usually bound to. */
+int
+ncsh_accept_suggestion (int count, int key)
+{
+  if (ncsh_suggestion.has_suggestion && rl_point == rl_end)
+    {
+      rl_insert_text (ncsh_suggestion.suggestion);
+      ncsh_suggestion.has_suggestion = 0;
+      return 0;
+    }
+
+  return (rl_forward_char (count, key));
+}
+
+/* Add each argument of each command in LINE to the argument tree of its
+   command word in COMMANDS, with WEIGHT. */
+void
+ncsh_add_command_autocompletions (Autocompletion_Commands *commands, const char *line,
+				  uint_fast32_t weight, Arena *arena)
+{
+  char **words;
+  size_t i;
+  Autocompletion_Node *tree;
+
+  if (commands == 0 || line == 0 || arena == 0 || (words = history_tokenize (line)) == 0)
+    return;
+
+  tree = 0;
+  for (i = 0; words[i]; i++)
+    {
+      if (ncsh_command_separator (words[i]))
+	tree = 0;
+      else if (tree == 0)
+	tree = ncsh_autocompletions_command_add (commands, words[i], strlen (words[i]) + 1, arena);
+      else
+	ncsh_autocompletions_add_weighted (words[i], strlen (words[i]) + 1, weight, tree, arena);
+    }
+
+  ncsh_free_words (words);
+}
+
+/* Take WEIGHT off LINE in INPUT->tree and off each of its arguments in
+   INPUT->commands, the reverse of adding it.  A WEIGHT of 0 takes all of
+   LINE out and as much off its arguments as it had. */
+void
+ncsh_remove_autocompletions (readline_input *input, const char *line, uint_fast32_t weight)
+{
+  char **words;
+  size_t i;
+  Autocompletion_Node *tree;
+
+  if (input == 0 || input->tree == 0 || line == 0)
+    return;
+
+  ncsh_build_record (line, 1, weight);
+  if (weight == 0)
+    weight = ncsh_autocompletions_remove (line, strlen (line) + 1, input->tree);
+  else
+    ncsh_autocompletions_decrement (line, strlen (line) + 1, weight, input->tree);
+
+  if (weight == 0 || input->commands == 0 || (words = history_tokenize (line)) == 0)
+    return;
+
+  tree = 0;
+  for (i = 0; words[i]; i++)
+    {
+      if (ncsh_command_separator (words[i]))
+	tree = 0;
+      else if (tree == 0)
+	tree = ncsh_autocompletions_command_search (input->commands, words[i], strlen (words[i]) + 1);
+      else
+	ncsh_autocompletions_decrement (words[i], strlen (words[i]) + 1, weight, tree);
+    }
+
+  ncsh_free_words (words);
+}
+
+/* Add every entry in the history list to TREE, and its arguments to
+   COMMANDS if that is not NULL.  Entries with a timestamp are weighted by
+   how recently they were used (see ncsh_autocompletions_frecency); entries
+   without one count once. */
+void
+ncsh_add_history_autocompletions (Autocompletion_Node *tree, Autocompletion_Commands *commands,
+				  Arena *arena)
+{
+  HIST_ENTRY **list;
+  time_t now, used;
+  uint_fast32_t weight;
+  int i;
+
+  if (tree == 0 || arena == 0 || (list = history_list ()) == 0)
+    return;
+
+  now = time ((time_t *)NULL);
+  for (i = 0; list[i]; i++)
+    {
+      used = history_get_time (list[i]);
+      weight = used ? ncsh_autocompletions_frecency (used, now) : 1;
+      ncsh_autocompletions_add_weighted (list[i]->line, strlen (list[i]->line) + 1, weight, tree, arena);
+      ncsh_add_command_autocompletions (commands, list[i]->line, weight, arena);
+    }
+}
+
+/* Make accept-suggestion known by name and bind it to the forward-char
+   keys.  Done before rl_initialize reads the inputrc, so users can still
+   bind it elsewhere or give the keys back to forward-char. */
+static void
+ncsh_suggestion_initialize (void)
+{
+  static int initialized = 0;
+
+  if (initialized)
+    return;
+  initialized = 1;
+
+  rl_add_funmap_entry ("accept-suggestion", ncsh_accept_suggestion);
+
+  rl_bind_key_in_map (CTRL ('F'), ncsh_accept_suggestion, emacs_standard_keymap);
+  rl_bind_keyseq_in_map ("\033[C", ncsh_accept_suggestion, emacs_standard_keymap);
+  rl_bind_keyseq_in_map ("\033OC", ncsh_accept_suggestion, emacs_standard_keymap);
+#if defined (VI_MODE)
+  rl_bind_keyseq_in_map ("\033[C", ncsh_accept_suggestion, vi_insertion_keymap);
+  rl_bind_keyseq_in_map ("\033OC", ncsh_accept_suggestion, vi_insertion_keymap);
+#endif
+}
+
+/* Background tree building.  A worker thread reads the history file into a
+   new tree in an arena of its own and publishes it with an atomic pointer
+   store.  ncsh_readline picks it up at the start of its next call, a safe
+   point where nothing is walking the current tree: the lines added and
+   removed since the build started are added and removed again on the new
+   tree, the new tree takes its place in the input, and the arena of the
+   tree it replaced is freed if an earlier build made it.  Only those
+   changes carry over, what the current tree held before comes from the
+   history file again. */
+struct ncsh_build
+{
+  char *path;
+  Arena arena;
+  Autocompletion_Node *tree;
+  Autocompletion_Commands commands;
+  int with_commands;
+  pthread_t thread;
+};
+
+/* A line added or removed while a build runs. */
+struct ncsh_build_change
+{
+  struct ncsh_build_change *next;
+  char *line;
+  int removed;
+  uint_fast32_t weight;		/* taken off a removed line, 0 for all of it */
+};
+
+static struct
+{
+  _Atomic (struct ncsh_build *) published;
+  struct ncsh_build *running;	/* started and not published yet */
+  Arena current;		/* arena of the last tree swapped in, if a build made it */
+  Arena changes_arena;		/* changes made while the build runs, in order */
+  struct ncsh_build_change *changes, *last_change;
+} ncsh_builder;
+
+#define NCSH_BUILD_ARENA_SIZE (1 << 20)
+
+/* Lines in history files written with history_write_timestamps set are
+   preceded by a `#' and the time they were run. */
+static time_t
+ncsh_build_timestamp (const char *line)
+{
+  if (line[0] != '#' || _rl_digit_p (line[1]) == 0 || line[strspn (line + 1, "0123456789") + 1] != '\0')
+    return 0;
+  return (time_t)strtol (line + 1, (char **)NULL, 10);
+}
+
+static void *
+ncsh_build_worker (void *arg)
+{
+  struct ncsh_build *build;
+  FILE *file;
+  char *line;
+  size_t size;
+  ssize_t length;
+  time_t now, used;
+  uint_fast32_t weight;
+
+  build = arg;
+  now = time ((time_t *)NULL);
+  used = 0;
+  line = (char *)NULL;
+  size = 0;
+  if ((file = fopen (build->path, "r")))
+    {
+      while ((length = getline (&line, &size, file)) >= 0)
+	{
+	  if (length && line[length - 1] == '\n')
+	    line[--length] = '\0';
+	  if (length == 0)
+	    continue;
+	  if (ncsh_build_timestamp (line))
+	    {
+	      used = ncsh_build_timestamp (line);
+	      continue;
+	    }
+
+	  weight = used ? ncsh_autocompletions_frecency (used, now) : 1;
+	  ncsh_autocompletions_add_weighted (line, length + 1, weight, build->tree, &build->arena);
+	  if (build->with_commands)
+	    ncsh_add_command_autocompletions (&build->commands, line, weight, &build->arena);
+	  used = 0;
+	}
+      fclose (file);
+    }
+  free (line);
+
+  atomic_store_explicit (&ncsh_builder.published, build, memory_order_release);
+  return (void *)NULL;
+}
+
+/* Remember LINE was added or removed while the build runs, to do it again
+   on the built tree. */
+static void
+ncsh_build_record (const char *line, int removed, uint_fast32_t weight)
+{
+  struct ncsh_build_change *change;
+
+  if (ncsh_builder.running == 0)
+    return;
+
+  change = arena_malloc (&ncsh_builder.changes_arena, 1, struct ncsh_build_change);
+  change->line = arena_malloc (&ncsh_builder.changes_arena, strlen (line) + 1, char);
+  strcpy (change->line, line);
+  change->removed = removed;
+  change->weight = weight;
+  if (ncsh_builder.last_change)
+    ncsh_builder.last_change->next = change;
+  else
+    ncsh_builder.changes = change;
+  ncsh_builder.last_change = change;
+}
+
+int
+ncsh_build_autocompletions (readline_input *input, const char *history_file)
+{
+  struct ncsh_build *build;
+  Arena arena;
+
+  if (input == 0 || history_file == 0 || ncsh_builder.running)
+    return 1;
+  if (ncsh_arena_create (&arena, NCSH_BUILD_ARENA_SIZE) == false)
+    return 1;
+  if (ncsh_arena_create (&ncsh_builder.changes_arena, 1 << 16) == false)
+    {
+      ncsh_arena_destroy (&arena);
+      return 1;
+    }
+
+  /* the build lives in its own arena, freed along with the tree */
+  build = arena_malloc (&arena, 1, struct ncsh_build);
+  build->path = arena_malloc (&arena, strlen (history_file) + 1, char);
+  strcpy (build->path, history_file);
+  build->tree = ncsh_autocompletions_alloc (&arena);
+  build->with_commands = input->commands != 0;
+  build->arena = arena;
+
+  if (pthread_create (&build->thread, (pthread_attr_t *)NULL, ncsh_build_worker, build))
+    {
+      ncsh_arena_destroy (&arena);
+      ncsh_arena_destroy (&ncsh_builder.changes_arena);
+      return 1;
+    }
+
+  ncsh_builder.changes = ncsh_builder.last_change = (struct ncsh_build_change *)NULL;
+  ncsh_builder.running = build;
+  return 0;
+}
+
+static void
+ncsh_build_swap (readline_input *input)
+{
+  struct ncsh_build *build;
+  struct ncsh_build_change *change;
+  readline_input built;
+  Arena previous;
+
+  build = atomic_exchange_explicit (&ncsh_builder.published, (struct ncsh_build *)NULL, memory_order_acquire);
+  if (build == 0)
+    return;
+  pthread_join (build->thread, (void **)NULL);
+  ncsh_builder.running = (struct ncsh_build *)NULL;
+
+  /* The history file may not have the lines changed since the build
+     started yet, or still have the ones removed. */
+  built = *input;
+  built.tree = build->tree;
+  built.commands = build->with_commands ? &build->commands : input->commands;
+  for (change = ncsh_builder.changes; change; change = change->next)
+    if (change->removed)
+      ncsh_remove_autocompletions (&built, change->line, change->weight);
+    else
+      {
+	ncsh_autocompletions_add (change->line, strlen (change->line) + 1, build->tree, &build->arena);
+	if (build->with_commands)
+	  ncsh_add_command_autocompletions (&build->commands, change->line, 1, &build->arena);
+      }
+  ncsh_arena_destroy (&ncsh_builder.changes_arena);
+  ncsh_builder.changes = ncsh_builder.last_change = (struct ncsh_build_change *)NULL;
+
+  if (input->commands && build->with_commands)
+    *input->commands = build->commands;
+  input->tree = build->tree;
+
+  previous = ncsh_builder.current;
+  ncsh_builder.current = build->arena;
+  ncsh_arena_destroy (&previous);
+}
+
+void
+ncsh_compact_autocompletions (readline_input *input, Arena *arena)
+{
+  Arena previous;
+
+  if (input == 0 || input->tree == 0 || arena == 0)
+    return;
+
+  input->tree = ncsh_autocompletions_compact (input->tree, arena);
+  if (input->commands)
+    ncsh_autocompletions_commands_compact (input->commands, arena);
+
+  /* Nothing points into the arena of a built tree any more. */
+  previous = ncsh_builder.current;
+  ncsh_builder.current = (Arena){0};
+  ncsh_arena_destroy (&previous);
+}
+
+/* Sharing the tree between sessions.  The tree lives in a file under
+   $XDG_RUNTIME_DIR that every session maps (see ncsh_autocompletions_share),
+   so the pages of the tree are only in memory once, and a line added in
+   one session is published to the file's journal and added to the trees
+   (and argument trees) of the others at the start of their next
+   ncsh_readline call.
+   The nodes those lines add live in an arena of the attachment, freed
+   with the tree when the file is renewed and every session moves to the
+   new one.  A line is kept until then: if the session renewing gave up
+   waiting for a record before it, it is published to the new file again. */
+#if !defined (NCSH_SHARED_JOURNAL_SIZE)
+#  define NCSH_SHARED_JOURNAL_SIZE (1 << 20)
+#endif
+
+struct ncsh_published
+{
+  char *line;
+  uint64_t end;		/* journal bytes up to the end of its record, UINT64_MAX
+			   while it is waiting for the next file */
+};
+
+static struct
+{
+  char *path;
+  struct ncsh_Autocompletions_Shared shared;
+  Arena *arena;			/* the application's, for the argument trees */
+  Arena nodes;			/* nodes of the attached tree outside the file */
+  int attached;
+  uint64_t commands;		/* journal bytes added to the argument trees */
+  struct ncsh_published *published;	/* lines published to the attached file */
+  size_t published_count, published_size;
+} ncsh_sharing;
+
+static void
+ncsh_sharing_published (const char *line, uint64_t end)
+{
+  if (ncsh_sharing.published_count == ncsh_sharing.published_size)
+    {
+      ncsh_sharing.published_size = ncsh_sharing.published_size ? ncsh_sharing.published_size * 2 : 16;
+      ncsh_sharing.published = (struct ncsh_published *)xrealloc (ncsh_sharing.published,
+								  ncsh_sharing.published_size * sizeof (struct ncsh_published));
+    }
+  ncsh_sharing.published[ncsh_sharing.published_count].line = savestring (line);
+  ncsh_sharing.published[ncsh_sharing.published_count++].end = end;
+}
+
+/* Add the journal entries up to END to the argument trees, following
+   what the tree has. */
+static void
+ncsh_sharing_commands (readline_input *input, uint64_t end)
+{
+  char line[MAX_INPUT];
+  const char *entry;
+  size_t length;
+  uint64_t position;
+
+  if (input->commands == 0)
+    return;
+  position = ncsh_sharing.commands;
+  while (position < end && (entry = ncsh_autocompletions_entry (&ncsh_sharing.shared, &position, &length)))
+    {
+      memcpy (line, entry, length);
+      line[length] = '\0';
+      ncsh_add_command_autocompletions (input->commands, line, 1, ncsh_sharing.arena);
+      ncsh_sharing.commands = position;
+    }
+}
+
+/* Attach to the file at the path, replacing the tree of the file attached
+   to before.  If that fails, the old tree is kept. */
+static int
+ncsh_sharing_attach (readline_input *input)
+{
+  struct ncsh_Autocompletions_Shared shared;
+  struct ncsh_published *lost;
+  Autocompletion_Node *root;
+  Arena nodes;
+  uint64_t folded, commands;
+  size_t i, lost_count;
+
+  if (ncsh_arena_create (&nodes, 1 << 16) == 0)
+    return 0;
+  root = ncsh_autocompletions_attach (ncsh_sharing.path, &shared, &nodes);
+  if (root == 0)
+    {
+      ncsh_arena_destroy (&nodes);
+      return 0;
+    }
+
+  /* The new file holds the old journal up to where the renewing session
+     folded it.  Lines published here past that are published again.  If
+     the file was not replaced, this is the same journal again. */
+  lost = (struct ncsh_published *)NULL;
+  lost_count = 0;
+  commands = 0;
+  if (ncsh_sharing.attached)
+    {
+      folded = ncsh_autocompletions_folded (&ncsh_sharing.shared);
+      if (folded == UINT64_MAX)
+	commands = ncsh_sharing.commands;
+      else
+	{
+	  ncsh_sharing_commands (input, folded);
+	  lost = ncsh_sharing.published;
+	  lost_count = ncsh_sharing.published_count;
+	  ncsh_sharing.published = (struct ncsh_published *)NULL;
+	  ncsh_sharing.published_count = ncsh_sharing.published_size = 0;
+	  for (i = 0; i < lost_count; i++)
+	    if (lost[i].end <= folded)
+	      {
+		xfree (lost[i].line);
+		lost[i].line = (char *)NULL;
+	      }
+	}
+      ncsh_autocompletions_detach (&ncsh_sharing.shared);
+    }
+  ncsh_arena_destroy (&ncsh_sharing.nodes);
+
+  ncsh_sharing.shared = shared;
+  ncsh_sharing.nodes = nodes;
+  ncsh_sharing.attached = 1;
+  ncsh_sharing.commands = commands;
+  input->tree = root;
+  ncsh_sharing_commands (input, ncsh_sharing.shared.position);
+
+  for (i = 0; i < lost_count; i++)
+    if (lost[i].line)
+      {
+	if (ncsh_autocompletions_publish (&ncsh_sharing.shared, lost[i].line, strlen (lost[i].line) + 1))
+	  ncsh_sharing_published (lost[i].line, ncsh_sharing.shared.published);
+	else
+	  {
+	    /* The new journal is full already: it is kept for the next
+	       file, the argument trees get it from the journal it reaches. */
+	    ncsh_autocompletions_add (lost[i].line, strlen (lost[i].line) + 1, input->tree, &ncsh_sharing.nodes);
+	    ncsh_sharing_published (lost[i].line, UINT64_MAX);
+	  }
+	xfree (lost[i].line);
+      }
+  FREE (lost);
+  return 1;
+}
+
+int
+ncsh_share_autocompletions (readline_input *input, const char *path, Arena *arena)
+{
+  const char *directory;
+  Arena scratch;
+  int created;
+
+  if (input == 0 || arena == 0 || ncsh_sharing.attached)
+    return 1;
+
+  if (path == 0)
+    {
+      directory = sh_get_env_value ("XDG_RUNTIME_DIR");
+      if (directory == 0 || *directory == '\0')
+	return 1;
+      ncsh_sharing.path = (char *)xmalloc (strlen (directory) + sizeof ("/ncsh_autocompletions"));
+      sprintf (ncsh_sharing.path, "%s/ncsh_autocompletions", directory);
+    }
+  else
+    ncsh_sharing.path = savestring (path);
+  ncsh_sharing.arena = arena;
+
+  if (ncsh_sharing_attach (input))
+    return 0;
+
+  /* The first session creates the file from its tree.  If another one
+     created it meanwhile, attach to theirs; if what is there cannot be
+     attached to, it was left by an incompatible build and is replaced. */
+  if (input->tree == 0)
+    input->tree = ncsh_autocompletions_alloc (arena);
+  if (ncsh_arena_create (&scratch, 1 << 20) == 0)
+    return 1;
+  created = ncsh_autocompletions_share (ncsh_sharing.path, input->tree, NCSH_SHARED_JOURNAL_SIZE, scratch);
+  if (created == 0 && ncsh_sharing_attach (input) == 0)
+    {
+      unlink (ncsh_sharing.path);
+      created = ncsh_autocompletions_share (ncsh_sharing.path, input->tree, NCSH_SHARED_JOURNAL_SIZE, scratch);
+    }
+  ncsh_arena_destroy (&scratch);
+  if (ncsh_sharing.attached == 0)
+    ncsh_sharing_attach (input);
+
+  if (ncsh_sharing.attached)
+    return 0;
+  xfree (ncsh_sharing.path);
+  ncsh_sharing.path = (char *)NULL;
+  return 1;
+}
+
+/* Called at the start of ncsh_readline, where nothing walks the tree. */
+static void
+ncsh_sharing_sync (readline_input *input)
+{
+  int synced;
+
+  if (ncsh_sharing.attached == 0)
+    return;
+  synced = ncsh_autocompletions_sync (&ncsh_sharing.shared, input->tree, &ncsh_sharing.nodes);
+  ncsh_sharing_commands (input, ncsh_sharing.shared.position);
+  if (synced < 0)
+    ncsh_sharing_attach (input);
+}
+
+void
+ncsh_add_autocompletions (readline_input *input, const char *line, Arena *arena)
+{
+  Arena scratch;
+  size_t length;
+  int renewed, published;
+
+  if (input == 0 || line == 0 || (length = strlen (line) + 1) > MAX_INPUT)
+    return;
+
+  ncsh_build_record (line, 0, 1);
+  if (ncsh_sharing.attached == 0)
+    {
+      if (input->commands)
+	ncsh_add_command_autocompletions (input->commands, line, 1, arena);
+      if (input->tree)
+	ncsh_autocompletions_add (line, length, input->tree, arena);
+      return;
+    }
+
+  /* A full journal is folded into a new file, which every session moves
+     to.  Whoever finds it full first writes it, the others wait for it.
+     Each time publishing fails the sessions have moved to a new file, so
+     it is tried again until the line is in a journal or renewing fails.
+     The line reaches the tree and the argument trees from the journal. */
+  published = 0;
+  while (ncsh_autocompletions_record_size (length) <= NCSH_SHARED_JOURNAL_SIZE)
+    {
+      if ((published = ncsh_autocompletions_publish (&ncsh_sharing.shared, line, length)))
+	{
+	  ncsh_sharing_published (line, ncsh_sharing.shared.published);
+	  break;
+	}
+      if (ncsh_arena_create (&scratch, 1 << 20) == 0)
+	break;
+      renewed = ncsh_autocompletions_renew (ncsh_sharing.path, &ncsh_sharing.shared, input->tree,
+					    NCSH_SHARED_JOURNAL_SIZE, &ncsh_sharing.nodes, scratch);
+      ncsh_arena_destroy (&scratch);
+      if (renewed == 0 || ncsh_sharing_attach (input) == 0)
+	break;
+    }
+  /* The other sessions miss it, this one keeps it at least. */
+  if (published == 0)
+    {
+      ncsh_autocompletions_add (line, length, input->tree, &ncsh_sharing.nodes);
+      ncsh_add_command_autocompletions (input->commands, line, 1, ncsh_sharing.arena);
+    }
+  ncsh_sharing_sync (input);
+}
+
+/* Completion.  When the application has not set its own
+   rl_attempted_completion_function, ncsh_readline completes from several
+   sources and merges what they find into one list:
+     history   words the line's history trie continues TEXT with; in command
+	       position from the lines that start with it, elsewhere from the
+	       argument tree of the word's command.
+     commands  executables in $PATH, in command position, from an index
+	       kept across lines.
+     files     rl_filename_completion_function.
+   Matches are deduplicated and ranked by history weight, the rest
+   alphabetically, and readline shows them in that order.
+   Each source has a time budget and offers what it found when it runs
+   out: a large history trie, a $PATH with many or slow directories and
+   a slow file system all stay interactive.  The $PATH index goes on
+   reading where it stopped on the next TAB.
+   The merged list is kept for the next TAB, keyed by the word and the
+   command it is an argument of.  The same word reuses it, and while the
+   word only grows without a `/' or blank, a list no source cut short is
+   filtered instead of gathered again.  The filename source keeps what it
+   read the same way, for lists that are gathered again. */
+#if !defined (NCSH_COMPLETION_HISTORY_MAX)
+#  define NCSH_COMPLETION_HISTORY_MAX 64
+#endif
+#if !defined (NCSH_COMPLETION_HISTORY_BUDGET)
+#  define NCSH_COMPLETION_HISTORY_BUDGET 5000	/* microseconds */
+#endif
+#if !defined (NCSH_COMPLETION_COMMANDS_BUDGET)
+#  define NCSH_COMPLETION_COMMANDS_BUDGET 20000	/* microseconds */
+#endif
+#if !defined (NCSH_COMPLETION_FILES_BUDGET)
+#  define NCSH_COMPLETION_FILES_BUDGET 20000	/* microseconds */
+#endif
+
+struct ncsh_completion_source
+{
+  int valid;
+  int complete;			/* not cut short by the budget */
+  char *text;			/* word the names were read for */
+  char **names;
+  size_t count, size;
+};
+
+struct ncsh_candidate
+{
+  char *word;
+  unsigned long weight;		/* history weight, 0 if only found elsewhere */
+};
+
+static struct
+{
+  readline_input *input;	/* input of the ncsh_readline call running */
+  struct ncsh_completion_source files;
+  struct ncsh_candidate *candidates;
+  size_t count, size, next;
+  char *text;			/* word the candidates were gathered for */
+  char *command;		/* its command, NULL in command position */
+  int cut;			/* a source ran out of its budget */
+  int capped;			/* history found NCSH_COMPLETION_HISTORY_MAX words */
+  int filenames;		/* the filename source found any */
+} ncsh_completion;
+
+static unsigned long long
+ncsh_completion_clock (void)
+{
+  struct timespec now;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return ((unsigned long long)now.tv_sec * 1000000 + now.tv_nsec / 1000);
+}
+
+static void
+ncsh_completion_source_clear (struct ncsh_completion_source *source)
+{
+  size_t i;
+
+  for (i = 0; i < source->count; i++)
+    xfree (source->names[i]);
+  source->count = 0;
+  FREE (source->text);
+  source->text = (char *)NULL;
+  source->valid = source->complete = 0;
+}
+
+/* Whether SOURCE can answer for TEXT without reading the directories
+   again.  Filenames are only filtered while no `/' is typed, which would
+   move on to another directory. */
+static int
+ncsh_completion_source_usable (struct ncsh_completion_source *source, const char *text)
+{
+  size_t length;
+
+  if (source->valid == 0)
+    return 0;
+  if (STREQ (source->text, text))
+    return 1;
+  length = strlen (source->text);
+  return (source->complete && STREQN (source->text, text, length) && strchr (text + length, '/') == 0);
+}
+
+static void
+ncsh_completion_source_add (struct ncsh_completion_source *source, char *name)
+{
+  if (source->count == source->size)
+    {
+      source->size = source->size ? source->size * 2 : 64;
+      source->names = (char **)xrealloc (source->names, source->size * sizeof (char *));
+    }
+  source->names[source->count++] = name;
+}
+
+static void
+ncsh_completion_source_start (struct ncsh_completion_source *source, const char *text)
+{
+  ncsh_completion_source_clear (source);
+  source->text = savestring (text);
+  source->valid = source->complete = 1;
+}
+
+static void
+ncsh_completion_files (const char *text)
+{
+  struct ncsh_completion_source *source;
+  unsigned long long deadline;
+  char *name;
+  int state;
+
+  source = &ncsh_completion.files;
+  if (ncsh_completion_source_usable (source, text))
+    return;
+  ncsh_completion_source_start (source, text);
+
+  deadline = ncsh_completion_clock () + NCSH_COMPLETION_FILES_BUDGET;
+  for (state = 0; (name = rl_filename_completion_function (text, state)); state++)
+    {
+      ncsh_completion_source_add (source, name);
+      if (ncsh_completion_clock () > deadline)
+	{
+	  /* The next call with a state of 0 closes the directory. */
+	  source->complete = 0;
+	  break;
+	}
+    }
+}
+
+static void
+ncsh_completion_clear (void)
+{
+  size_t i;
+
+  for (i = 0; i < ncsh_completion.count; i++)
+    xfree (ncsh_completion.candidates[i].word);
+  ncsh_completion.count = 0;
+  FREE (ncsh_completion.text);
+  FREE (ncsh_completion.command);
+  ncsh_completion.text = ncsh_completion.command = (char *)NULL;
+  ncsh_completion.cut = ncsh_completion.capped = ncsh_completion.filenames = 0;
+}
+
+static void
+ncsh_completion_add (const char *text, const char *rest, size_t length, unsigned long weight)
+{
+  struct ncsh_candidate *candidate;
+  size_t text_length;
+
+  if (ncsh_completion.count == ncsh_completion.size)
+    {
+      ncsh_completion.size = ncsh_completion.size ? ncsh_completion.size * 2 : 64;
+      ncsh_completion.candidates = (struct ncsh_candidate *)xrealloc (ncsh_completion.candidates,
+								     ncsh_completion.size * sizeof (struct ncsh_candidate));
+    }
+  text_length = strlen (text);
+  candidate = &ncsh_completion.candidates[ncsh_completion.count++];
+  candidate->word = (char *)xmalloc (text_length + length + 1);
+  memcpy (candidate->word, text, text_length);
+  memcpy (candidate->word + text_length, rest, length);
+  candidate->word[text_length + length] = '\0';
+  candidate->weight = weight;
+}
+
+/* The executables in $PATH, kept in a tree of their own so completing a
+   command word does not read any directory.  The index is rebuilt when
+   $PATH changes or one of its directories does.  Where inotify is
+   available each directory is watched and checking is a read of the
+   inotify descriptor; directories that could not be watched, e.g. ones
+   that do not exist yet, are checked by their modification time.
+   Building is done a budget at a time: the directory being read stays
+   open between TABs, and until the last one is read the names found so
+   far are filtered one by one. */
+struct ncsh_path_directory
+{
+  char *name;
+  struct timespec mtime;	/* zero if it did not exist */
+  int watched;
+};
+
+static struct
+{
+  char *path;			/* $PATH the index was built for */
+  struct ncsh_path_directory *directories;
+  size_t count;
+  int inotify;			/* -1 without inotify */
+  Arena arena;
+  Arena scratch;
+  Autocompletion_Node *tree;	/* NULL until every directory was read */
+  size_t names;			/* entries in the tree */
+  size_t bytes;			/* their lengths summed, with terminators */
+  size_t read;			/* directories read so far */
+  DIR *dir;			/* the one being read, if open */
+  struct ncsh_String *pending;	/* names read so far, for the tree */
+  size_t pending_count, pending_size;
+} ncsh_path_index = { .inotify = -1 };
+
+static void
+ncsh_path_index_mtime (const char *name, struct timespec *mtime)
+{
+  struct stat finfo;
+
+  if (stat (name, &finfo) == 0)
+    *mtime = finfo.st_mtim;
+  else
+    mtime->tv_sec = mtime->tv_nsec = 0;
+}
+
+static int
+ncsh_path_index_current (const char *path)
+{
+  char events[4096];
+  struct timespec mtime;
+  size_t i;
+  int changed;
+
+  if (ncsh_path_index.path == 0 || STREQ (ncsh_path_index.path, path) == 0)
+    return 0;
+  /* Still being read: changes meanwhile are seen once it is built. */
+  if (ncsh_path_index.tree == 0)
+    return 1;
+
+  changed = 0;
+#if defined (__linux__)
+  if (ncsh_path_index.inotify >= 0)
+    while (read (ncsh_path_index.inotify, events, sizeof (events)) > 0)
+      changed = 1;
+#endif
+  for (i = 0; changed == 0 && i < ncsh_path_index.count; i++)
+    if (ncsh_path_index.directories[i].watched == 0)
+      {
+	ncsh_path_index_mtime (ncsh_path_index.directories[i].name, &mtime);
+	changed = mtime.tv_sec != ncsh_path_index.directories[i].mtime.tv_sec ||
+		  mtime.tv_nsec != ncsh_path_index.directories[i].mtime.tv_nsec;
+      }
+  return (changed == 0);
+}
+
+static void
+ncsh_path_index_clear (void)
+{
+  size_t i;
+
+  for (i = 0; i < ncsh_path_index.count; i++)
+    xfree (ncsh_path_index.directories[i].name);
+  FREE (ncsh_path_index.directories);
+  ncsh_path_index.directories = (struct ncsh_path_directory *)NULL;
+  ncsh_path_index.count = 0;
+  FREE (ncsh_path_index.path);
+  ncsh_path_index.path = (char *)NULL;
+  ncsh_path_index.tree = (Autocompletion_Node *)NULL;
+  ncsh_path_index.names = ncsh_path_index.bytes = 0;
+  ncsh_path_index.read = 0;
+  if (ncsh_path_index.dir)
+    closedir (ncsh_path_index.dir);
+  ncsh_path_index.dir = (DIR *)NULL;
+  for (i = 0; i < ncsh_path_index.pending_count; i++)
+    xfree (ncsh_path_index.pending[i].value);
+  ncsh_path_index.pending_count = 0;
+  if (ncsh_path_index.inotify >= 0)
+    close (ncsh_path_index.inotify);
+  ncsh_path_index.inotify = -1;
+  ncsh_arena_reset (&ncsh_path_index.arena);
+}
+
+/* Forget the index and split PATH into the directories to read. */
+static void
+ncsh_path_index_start (const char *path)
+{
+  size_t length;
+  const char *end;
+
+  if ((ncsh_path_index.arena.chunk == 0 && ncsh_arena_create (&ncsh_path_index.arena, 1 << 20) == 0) ||
+      (ncsh_path_index.scratch.chunk == 0 && ncsh_arena_create (&ncsh_path_index.scratch, 1 << 20) == 0))
+    return;
+  ncsh_path_index_clear ();
+  ncsh_path_index.path = savestring (path);
+#if defined (__linux__)
+  ncsh_path_index.inotify = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+#endif
+
+  for (; path; path = *end ? end + 1 : (char *)NULL)
+    {
+      end = strchr (path, ':');
+      if (end == 0)
+	end = path + strlen (path);
+      length = end - path;
+      ncsh_path_index.directories = (struct ncsh_path_directory *)xrealloc (ncsh_path_index.directories,
+									    (ncsh_path_index.count + 1) * sizeof (struct ncsh_path_directory));
+      /* An empty entry is the current directory. */
+      ncsh_path_index.directories[ncsh_path_index.count].name = length ? savestring (path) : savestring (".");
+      ncsh_path_index.directories[ncsh_path_index.count].name[length ? length : 1] = '\0';
+      ncsh_path_index.directories[ncsh_path_index.count].watched = 0;
+      ncsh_path_index.count++;
+    }
+}
+
+static int
+ncsh_path_index_executable (DIR *dir, const char *name)
+{
+  struct stat finfo;
+
+  if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+    return 0;
+  return (fstatat (dirfd (dir), name, &finfo, 0) == 0 && S_ISREG (finfo.st_mode) &&
+	  faccessat (dirfd (dir), name, X_OK, 0) == 0);
+}
+
+/* Read the executables in the directories left into the pending names
+   until DEADLINE, and build the tree once the last one is read. */
+static void
+ncsh_path_index_read (unsigned long long deadline)
+{
+  struct ncsh_path_directory *directory;
+  struct dirent *entry;
+  size_t i;
+
+  for (; ncsh_path_index.read < ncsh_path_index.count; ncsh_path_index.read++)
+    {
+      directory = &ncsh_path_index.directories[ncsh_path_index.read];
+      if (ncsh_path_index.dir == 0)
+	{
+#if defined (__linux__)
+	  if (ncsh_path_index.inotify >= 0)
+	    directory->watched = inotify_add_watch (ncsh_path_index.inotify, directory->name,
+						    IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB |
+						    IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR) >= 0;
+#endif
+	  /* Taken before reading, so a change made meanwhile is seen next time. */
+	  if (directory->watched == 0)
+	    ncsh_path_index_mtime (directory->name, &directory->mtime);
+	  if ((ncsh_path_index.dir = opendir (directory->name)) == 0)
+	    continue;
+	}
+
+      while ((entry = readdir (ncsh_path_index.dir)))
+	{
+	  if (ncsh_path_index_executable (ncsh_path_index.dir, entry->d_name))
+	    {
+	      if (ncsh_path_index.pending_count == ncsh_path_index.pending_size)
+		{
+		  ncsh_path_index.pending_size = ncsh_path_index.pending_size ? ncsh_path_index.pending_size * 2 : 1024;
+		  ncsh_path_index.pending = (struct ncsh_String *)xrealloc (ncsh_path_index.pending,
+									    ncsh_path_index.pending_size * sizeof (struct ncsh_String));
+		}
+	      ncsh_path_index.pending[ncsh_path_index.pending_count].value = savestring (entry->d_name);
+	      ncsh_path_index.pending[ncsh_path_index.pending_count].length = strlen (entry->d_name) + 1;
+	      ncsh_path_index.pending_count++;
+	    }
+	  /* Checked after each entry, so every call makes progress. */
+	  if (ncsh_completion_clock () > deadline)
+	    return;
+	}
+      closedir (ncsh_path_index.dir);
+      ncsh_path_index.dir = (DIR *)NULL;
+    }
+
+  ncsh_path_index.tree = ncsh_autocompletions_load (ncsh_path_index.pending, (const uint_fast32_t *)NULL,
+						   (int)ncsh_path_index.pending_count, &ncsh_path_index.arena,
+						   ncsh_path_index.scratch);
+  /* Names found in more than one directory are counted twice here, which
+     only makes the buffer for the matches bigger than needed. */
+  ncsh_path_index.names = ncsh_path_index.pending_count;
+  for (i = 0; i < ncsh_path_index.pending_count; i++)
+    {
+      ncsh_path_index.bytes += ncsh_path_index.pending[i].length;
+      xfree (ncsh_path_index.pending[i].value);
+    }
+  ncsh_path_index.pending_count = 0;
+}
+
+static void
+ncsh_completion_commands (const char *text)
+{
+  static Autocompletion_Span *spans;
+  static char *buffer;
+  static size_t spans_size, buffer_size;
+  char value[MAX_INPUT];
+  Autocompletion_Node *node;
+  const char *path;
+  uint_fast32_t count, i;
+  size_t length;
+
+  length = strlen (text);
+  if (length + 1 >= MAX_INPUT)
+    return;
+  path = sh_get_env_value ("PATH");
+  if (path == 0)
+    path = "";
+  if (ncsh_path_index_current (path) == 0)
+    ncsh_path_index_start (path);
+  if (ncsh_path_index.path == 0)
+    return;
+  if (ncsh_path_index.tree == 0)
+    ncsh_path_index_read (ncsh_completion_clock () + NCSH_COMPLETION_COMMANDS_BUDGET);
+  if (ncsh_path_index.tree == 0)
+    {
+      ncsh_completion.cut = 1;
+      for (i = 0; i < ncsh_path_index.pending_count; i++)
+	if (STREQN (ncsh_path_index.pending[i].value, text, length))
+	  ncsh_completion_add (text, ncsh_path_index.pending[i].value + length,
+			       ncsh_path_index.pending[i].length - 1 - length, 0);
+      return;
+    }
+  if (ncsh_path_index.names == 0)
+    return;
+
+  if (spans_size < ncsh_path_index.names)
+    {
+      spans_size = ncsh_path_index.names;
+      spans = (Autocompletion_Span *)xrealloc (spans, spans_size * sizeof (Autocompletion_Span));
+    }
+  if (buffer_size < ncsh_path_index.bytes)
+    {
+      buffer_size = ncsh_path_index.bytes;
+      buffer = (char *)xrealloc (buffer, buffer_size);
+    }
+
+  /* The matches are the names TEXT continues to, TEXT itself only if it
+     is a name. */
+  node = ncsh_autocompletions_search (text, length + 1, ncsh_path_index.tree);
+  if (node && node->is_end_of_a_word)
+    ncsh_completion_add (text, "", 0, 0);
+  count = ncsh_autocompletions_get_packed (text, length + 1, spans, spans_size, buffer, buffer_size,
+					   ncsh_path_index.tree, ncsh_path_index.scratch);
+  for (i = 0; i < count; i++)
+    {
+      ncsh_autocompletions_span_value (spans, i, buffer, value);
+      ncsh_completion_add (text, value, spans[i].length - 1, 0);
+    }
+}
+
+/* Add the words TREE continues TEXT with, cut at the first blank since a
+   line continues past the word being completed.  The values come from the
+   scratch arena, each the size of its match. */
+static void
+ncsh_completion_history (const char *text, Autocompletion_Node *tree)
+{
+  Autocompletion matches[NCSH_COMPLETION_HISTORY_MAX];
+  uint_fast32_t count, i;
+  size_t text_length;
+  bool complete;
+
+  text_length = strlen (text);
+  if (tree == 0 || text_length + 1 >= MAX_INPUT)
+    return;
+  count = ncsh_autocompletions_get_budgeted (text, text_length + 1, matches, NCSH_COMPLETION_HISTORY_MAX,
+					     NCSH_COMPLETION_HISTORY_BUDGET, &complete, tree,
+					     ncsh_completion.input->scratch_arena);
+  if (complete == 0)
+    ncsh_completion.cut = 1;
+  if (count == NCSH_COMPLETION_HISTORY_MAX)
+    ncsh_completion.capped = 1;
+  for (i = 0; i < count; i++)
+    ncsh_completion_add (text, matches[i].value, strcspn (matches[i].value, " \t\n"), matches[i].weight);
+}
+
+static void
+ncsh_completion_filter (const char *text, struct ncsh_completion_source *source)
+{
+  size_t i, length;
+
+  length = strlen (text);
+  for (i = 0; i < source->count; i++)
+    if (STREQN (source->names[i], text, length))
+      ncsh_completion_add (text, source->names[i] + length, strlen (source->names[i] + length), 0);
+}
+
+static int
+ncsh_candidate_word_compare (const void *a, const void *b)
+{
+  return (strcmp (((const struct ncsh_candidate *)a)->word, ((const struct ncsh_candidate *)b)->word));
+}
+
+static int
+ncsh_candidate_rank_compare (const void *a, const void *b)
+{
+  const struct ncsh_candidate *x, *y;
+
+  x = (const struct ncsh_candidate *)a;
+  y = (const struct ncsh_candidate *)b;
+  if (x->weight != y->weight)
+    return (x->weight > y->weight ? -1 : 1);
+  return (strcmp (x->word, y->word));
+}
+
+/* Merge candidates for the same word, adding up history weights: several
+   lines continuing TEXT with the same word all count for it. */
+static void
+ncsh_completion_rank (void)
+{
+  size_t i, kept;
+
+  if (ncsh_completion.count == 0)
+    return;
+  qsort (ncsh_completion.candidates, ncsh_completion.count, sizeof (struct ncsh_candidate), ncsh_candidate_word_compare);
+  for (i = 1, kept = 0; i < ncsh_completion.count; i++)
+    {
+      if (STREQ (ncsh_completion.candidates[i].word, ncsh_completion.candidates[kept].word))
+	{
+	  ncsh_completion.candidates[kept].weight += ncsh_completion.candidates[i].weight;
+	  xfree (ncsh_completion.candidates[i].word);
+	}
+      else
+	ncsh_completion.candidates[++kept] = ncsh_completion.candidates[i];
+    }
+  ncsh_completion.count = kept + 1;
+  qsort (ncsh_completion.candidates, ncsh_completion.count, sizeof (struct ncsh_candidate), ncsh_candidate_rank_compare);
+}
+
+static char *
+ncsh_completion_generator (const char *text, int state)
+{
+  /* The candidates were found from TEXT already. */
+  (void)text;
+  if (state == 0)
+    ncsh_completion.next = 0;
+  if (ncsh_completion.next >= ncsh_completion.count)
+    return ((char *)NULL);
+  ncsh_completion.next++;
+  return (savestring (ncsh_completion.candidates[ncsh_completion.next - 1].word));
+}
+
+/* The command word of the command START is in, or NULL if the word at
+   START is the command word.  Uses the words ncsh_argument_suggestion
+   kept for the line. */
+static char *
+ncsh_completion_command (int start)
+{
+  struct ncsh_word command, last;
+  char *word;
+
+  if (ncsh_words_split (start, &command, &last) == 0)
+    return ((char *)NULL);
+  word = (char *)xmalloc (command.end - command.start + 1);
+  memcpy (word, rl_line_buffer + command.start, command.end - command.start);
+  word[command.end - command.start] = '\0';
+  return (word);
+}
+
+/* Whether the list gathered last can answer for TEXT, an argument of
+   COMMAND or in command position if it is NULL. */
+static int
+ncsh_completion_cached (const char *text, const char *command)
+{
+  size_t length;
+
+  if (ncsh_completion.text == 0 || ncsh_completion.cut)
+    return 0;
+  if ((ncsh_completion.command == 0) != (command == 0) ||
+      (command && STREQ (ncsh_completion.command, command) == 0))
+    return 0;
+  if (STREQ (ncsh_completion.text, text))
+    return 1;
+  /* A longer word leaves words capped history did not return, and a
+     `/' or blank changes what the sources look for. */
+  length = strlen (ncsh_completion.text);
+  return (ncsh_completion.capped == 0 && STREQN (ncsh_completion.text, text, length) &&
+	  text[length + strcspn (text + length, "/ \t\n")] == '\0');
+}
+
+/* Drop the candidates TEXT does not start, keeping their order. */
+static void
+ncsh_completion_narrow (const char *text)
+{
+  size_t i, kept, length;
+
+  if (STREQ (ncsh_completion.text, text))
+    return;
+  length = strlen (text);
+  for (i = kept = 0; i < ncsh_completion.count; i++)
+    if (STREQN (ncsh_completion.candidates[i].word, text, length))
+      ncsh_completion.candidates[kept++] = ncsh_completion.candidates[i];
+    else
+      xfree (ncsh_completion.candidates[i].word);
+  ncsh_completion.count = kept;
+  xfree (ncsh_completion.text);
+  ncsh_completion.text = savestring (text);
+}
+
+/* Ask every source for TEXT.  Takes COMMAND, which is kept as the key. */
+static void
+ncsh_completion_gather (const char *text, char *command)
+{
+  readline_input *input;
+  Autocompletion_Node *tree;
+
+  ncsh_completion_clear ();
+  ncsh_completion.text = savestring (text);
+  ncsh_completion.command = command;
+  input = ncsh_completion.input;
+  if (command == 0)
+    {
+      if (input)
+	ncsh_completion_history (text, input->tree);
+      if (strchr (text, '/') == 0)
+	ncsh_completion_commands (text);
+    }
+  else if (input && input->commands && (tree = ncsh_autocompletions_command_search (input->commands, command, strlen (command) + 1)))
+    ncsh_completion_history (text, tree);
+
+  ncsh_completion_files (text);
+  ncsh_completion_filter (text, &ncsh_completion.files);
+  if (ncsh_completion.files.complete == 0)
+    ncsh_completion.cut = 1;
+  ncsh_completion.filenames = ncsh_completion.files.count != 0;
+
+  ncsh_completion_rank ();
+}
+
+char **
+ncsh_completion_matches (const char *text, int start, int end)
+{
+  char *command;
+
+  (void)end;
+  command = ncsh_completion_command (start);
+  if (ncsh_completion_cached (text, command))
+    {
+      FREE (command);
+      ncsh_completion_narrow (text);
+    }
+  else
+    ncsh_completion_gather (text, command);
+
+  if (ncsh_completion.filenames)
+    rl_filename_completion_desired = 1;
+  rl_attempted_completion_over = 1;
+  rl_sort_completion_matches = 0;
+  return (rl_completion_matches (text, ncsh_completion_generator));
+}
+
+static void
+ncsh_completion_reset (readline_input *input)
+{
+  /* The current directory may have changed since the last line, and the
+     trees were synced. */
+  ncsh_completion.input = input;
+  ncsh_completion_clear ();
+  ncsh_completion_source_clear (&ncsh_completion.files);
+}
+
 STATIC_CALLBACK int
 #if defined (READLINE_CALLBACKS)
 ncsh_readline_internal_char (readline_input *input)
@@ -136,6 +1612,9 @@ ncsh_readline_internal_charloop (readlinereadline_input *input)
 	}
 
       last_character = character;
+      /* Commands see and redisplay the line without the suggestion; it is
+	 looked up again once the command is done. */
+      _rl_suggestion = (char *)NULL;
       r = _rl_dispatch ((unsigned char)character, _rl_keymap);
       RL_CHECK_SIGNALS ();
 
@@ -164,6 +1643,10 @@ ncsh_readline_internal_charloop (readlinereadline_input *input)
       if (rl_pending_input == 0 && lk == _rl_last_command_was_kill)
 	_rl_last_command_was_kill = 0;
 
+      ncsh_suggestion_update (input);
+      if (ncsh_suggestion.has_suggestion)
+	_rl_suggestion = ncsh_suggestion.suggestion;
+
       _rl_internal_char_cleanup ();
 
 #if defined (READLINE_CALLBACKS)
@@ -204,6 +1687,7 @@ char *
 ncsh_readline (readline_input *input)
 {
   char *value;
+  int completion, sort;
 #if 0
   int in_callback;
 #endif
@@ -226,6 +1710,17 @@ ncsh_readline (readline_input *input)
 
   rl_set_prompt (input->prompt);
 
+  ncsh_build_swap (input);
+  ncsh_sharing_sync (input);
+  ncsh_suggestion_initialize ();
+  ncsh_suggestion_reset (input->tree);
+  ncsh_completion_reset (input);
+
+  completion = rl_attempted_completion_function == 0;
+  sort = rl_sort_completion_matches;
+  if (completion)
+    rl_attempted_completion_function = ncsh_completion_matches;
+
   rl_initialize ();
   if (rl_prep_term_function)
     (*rl_prep_term_function) (_rl_meta_flag);
@@ -235,6 +1730,12 @@ ncsh_readline (readline_input *input)
 #endif
 
   value = ncsh_readline_internal (input);
+  _rl_suggestion = (char *)NULL;
+  if (completion)
+    {
+      rl_attempted_completion_function = (rl_completion_func_t *)NULL;
+      rl_sort_completion_matches = sort;
+    }
   if (rl_deprep_term_function)
     (*rl_deprep_term_function) ();
 
@@ -32,6 +32,11 @@ struct ncsh_Readline_Input {
   const char* prompt;
   Arena scratch_arena;
   Autocompletion_Node* tree;
+  /* Optional: argument trees per command word, see
+     ncsh_add_command_autocompletions.  When no earlier line starts like
+     the current one, the word being typed is completed from the arguments
+     its command was run with. */
+  Autocompletion_Commands* commands;
 };
 
 /* Typedef to keep consistent with readline style */
@@ -40,4 +45,72 @@ typedef struct ncsh_Readline_Input readline_input;
 char *
 ncsh_readline (readline_input *input);
 
+/* Bindable command, available as `accept-suggestion': insert the inline
+   suggestion shown after the cursor, or move forward a character if there
+   is none. */
+int
+ncsh_accept_suggestion (int count, int key);
+
+/* Complete TEXT from the history trie, the executables in $PATH and
+   filenames, ranked by history weight; ncsh_readline uses it unless
+   rl_attempted_completion_function is set.  An application with its own
+   can call it from there, with the same arguments. */
+char **
+ncsh_completion_matches (const char *text, int start, int end);
+
+/* Add the arguments of each command in a line to that command's argument
+   tree. */
+void
+ncsh_add_command_autocompletions (Autocompletion_Commands *commands, const char *line,
+				  uint_fast32_t weight, Arena *arena);
+
+/* Add the history list to an autocompletion tree, and to the argument
+   trees of COMMANDS if it is not NULL, most recently used entries weighted
+   highest when the history has timestamps. */
+void
+ncsh_add_history_autocompletions (Autocompletion_Node *tree, Autocompletion_Commands *commands,
+				  Arena *arena);
+
+/* Take WEIGHT off LINE and its arguments, e.g. when remove_history,
+   history_truncate_file or erasing duplicates drops the history entry
+   they were added for.  A WEIGHT of 0 removes LINE entirely. */
+void
+ncsh_remove_autocompletions (readline_input *input, const char *line, uint_fast32_t weight);
+
+/* Copy INPUT->tree and INPUT->commands into ARENA without what removals
+   and decays left behind, and point INPUT at the copies.  The arena the
+   old ones were in can be freed afterwards; a long running shell can
+   compact into a new arena now and then to keep the memory bounded. */
+void
+ncsh_compact_autocompletions (readline_input *input, Arena *arena);
+
+/* Fill the autocompletion tree from HISTORY_FILE on a worker thread, so
+   the first prompt does not wait for it.  The finished tree replaces
+   INPUT->tree (and the contents of INPUT->commands, if set) at the start
+   of the first ncsh_readline call after it is done.  Lines added and
+   removed meanwhile with ncsh_add_autocompletions and
+   ncsh_remove_autocompletions are added and removed again on it; anything
+   else in the old tree is dropped, so a tree seeded from the same history
+   is not counted twice.  Returns 0 if the thread was started. */
+int
+ncsh_build_autocompletions (readline_input *input, const char *history_file);
+
+/* Share INPUT->tree with the other sessions using the same file, PATH or
+   $XDG_RUNTIME_DIR/ncsh_autocompletions if PATH is NULL.  The first
+   session creates the file from its tree; the others replace their tree
+   with the one in the file.  Lines added later by any session reach
+   INPUT->commands, if set, with nodes from ARENA; the nodes they add to
+   the tree are freed with it when the file is renewed.  Add lines with
+   ncsh_add_autocompletions afterwards, so the other sessions see them.
+   Use it instead of ncsh_build_autocompletions, not with it.  Returns 0
+   if the tree is shared. */
+int
+ncsh_share_autocompletions (readline_input *input, const char *path, Arena *arena);
+
+/* Add LINE to INPUT->tree, and its arguments to INPUT->commands if set.
+   When the tree is shared, LINE is also added to the tree of every other
+   session at the start of its next ncsh_readline call. */
+void
+ncsh_add_autocompletions (readline_input *input, const char *line, Arena *arena);
+
 #endif /* !NCSH_READLINE_H_ */
@@ -271,6 +271,10 @@ struct _rl_cmd *_rl_command_to_execute = (struct _rl_cmd *)NULL;
    ambiguous multiple-key sequence */
 int _rl_keyseq_timeout = 500;
 
+/* Longest time (in milliseconds) the redisplay after a key may be put off
+   while more input is waiting to be read.  0 redisplays after every key. */
+int _rl_redisplay_max_delay = 50;
+
 #define RESIZE_KEYSEQ_BUFFER() \
   do \
     { \
@@ -485,6 +489,8 @@ readline_internal_teardown (int eof)
   if (eof)
     RL_SETSTATE (RL_STATE_EOF);		/* XXX */
 
+  _rl_flush_redisplay ();
+
   /* Restore the original of this history line, iff the line that we
      are editing was originally in the history, AND the line has changed. */
   entry = current_history ();
@@ -499,6 +505,7 @@ readline_internal_teardown (int eof)
       entry = replace_history_entry (where_history (), the_line, (histdata_t)NULL);
       _rl_free_history_entry (entry);
 
+      _rl_redisplay_damage (0);
       strcpy (the_line, temp);
       xfree (temp);
     }
@@ -544,7 +551,10 @@ _rl_internal_char_cleanup (void)
       rl_newline (1, '\n');
     }
 
-  if (rl_done == 0)
+  /* If more input is already waiting, as it is when text is pasted without
+     bracketed paste or a key repeats faster than the terminal can draw,
+     leave the screen alone until it has been read. */
+  if (rl_done == 0 && _rl_defer_redisplay () == 0)
     {
       (*rl_redisplay_function) ();
       _rl_want_redisplay = 0;
@@ -740,6 +750,7 @@ _rl_init_line_state (void)
   rl_point = rl_end = rl_mark = 0;
   the_line = rl_line_buffer;
   the_line[0] = 0;
+  _rl_redisplay_damage (0);
 }
 
 void
@@ -1518,6 +1529,7 @@ rl_restore_state (struct readline_state *sp)
   rl_end = sp->end;
   rl_mark = sp->mark;
   the_line = rl_line_buffer = sp->buffer;
+  _rl_redisplay_damage (0);
   rl_line_buffer_len = sp->buflen;
   rl_undo_list = sp->ul;
   rl_prompt = sp->prompt;
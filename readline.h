@@ -624,6 +624,22 @@ extern rl_getc_func_t *rl_getc_function;
 
 extern rl_voidfunc_t *rl_redisplay_function;
 
+/* Output counters kept by rl_redisplay, which collects each update into a
+   frame and writes it with a single write(2) where the terminal takes it
+   all at once.  FRAME_BYTES and FRAME_WRITES are for the last frame, and
+   FRAME_LINES is the number of screen lines it had to compare; lines
+   before the first change are skipped. */
+struct rl_redisplay_stats {
+  unsigned long frames;
+  unsigned long bytes;
+  unsigned long writes;
+  unsigned long frame_bytes;
+  unsigned long frame_writes;
+  unsigned long frame_lines;
+};
+
+extern struct rl_redisplay_stats rl_redisplay_stats;
+
 extern rl_vintfunc_t *rl_prep_term_function;
 extern rl_voidfunc_t *rl_deprep_term_function;
 
@@ -286,6 +286,8 @@ extern void _rl_clear_to_eol (int);
 extern void _rl_clear_screen (int);
 extern void _rl_update_final (void);
 extern void _rl_optimize_redisplay (void);
+extern void _rl_redisplay_damage (int);
+extern void _rl_flush_redisplay (void);
 extern void _rl_redisplay_after_sigwinch (void);
 extern void _rl_clean_up_for_exit (void);
 extern void _rl_erase_entire_line (void);
@@ -300,6 +302,7 @@ extern int _rl_input_queued (int);
 extern void _rl_insert_typein (int);
 extern int _rl_unget_char (int);
 extern int _rl_pushed_input_available (void);
+extern int _rl_defer_redisplay (void);
 
 extern int _rl_timeout_init (void);
 extern int _rl_timeout_handle_sigalrm (void);
@@ -409,6 +412,8 @@ extern void _rl_output_character_function (int);
 #else
 extern int _rl_output_character_function (int);
 #endif
+extern void _rl_frame_begin (void);
+extern void _rl_frame_end (void);
 extern void _rl_cr (void);
 extern void _rl_output_some_chars (const char *, int);
 extern int _rl_backspace (int);
@@ -421,6 +426,8 @@ extern void _rl_standout_off (void);
 extern int _rl_reset_region_color (int, const char *);
 extern void _rl_region_color_on (void);
 extern void _rl_region_color_off (void);
+extern void _rl_suggestion_color_on (void);
+extern void _rl_suggestion_color_off (void);
 
 /* text.c */
 extern void _rl_fix_point (int);
@@ -518,6 +525,8 @@ extern int _rl_vis_botlin;
 extern int _rl_last_c_pos;
 extern int _rl_suppress_redisplay;
 extern int _rl_want_redisplay;
+extern char *_rl_suggestion;
+extern int _rl_line_damage;
 
 extern char *_rl_emacs_mode_str;
 extern int _rl_emacs_modestr_len;
@@ -526,6 +535,9 @@ extern int _rl_vi_ins_modestr_len;
 extern char *_rl_vi_cmd_mode_str;
 extern int _rl_vi_cmd_modestr_len;
 
+/* input.c */
+extern int _rl_redisplay_deferred;
+
 /* isearch.c */
 extern char *_rl_isearch_terminators;
 
@@ -547,6 +559,7 @@ extern int _rl_utf8locale;
 extern int _rl_echoing_p;
 extern int _rl_horizontal_scroll_mode;
 extern int _rl_mark_modified_lines;
+extern int _rl_redisplay_max_delay;
 extern int _rl_bell_preference;
 extern int _rl_meta_flag;
 extern int _rl_convert_meta_chars_to_ascii;
@@ -593,6 +606,7 @@ extern int _rl_susp_char;
 /* terminal.c */
 extern int _rl_enable_keypad;
 extern int _rl_enable_meta;
+extern int _rl_synchronized_output;
 extern char *_rl_term_clreol;
 extern char *_rl_term_clrpag;
 extern char *_rl_term_clrscroll;
@@ -244,6 +244,7 @@ _rl_nsearch_init (int dir, int pchar)
   rl_undo_list = 0;
 
   /* Use the line buffer to read the search string. */
+  _rl_redisplay_damage (0);
   rl_line_buffer[0] = 0;
   rl_end = rl_point = 0;
 
@@ -47,6 +47,13 @@
 #endif
 
 #include <stdio.h>
+#include <errno.h>
+
+#if !defined (errno)
+extern int errno;
+#endif /* !errno */
+
+#include "posixselect.h"
 
 /* System-specific feature definitions and include files. */
 #include "rldefs.h"
@@ -156,6 +163,11 @@ static char *_rl_term_mo;
 static char *_rl_term_so;
 static char *_rl_term_se;
 
+/* The sequences to enter half-bright mode and exit all attributes, used
+   to draw inline suggestions. */
+static char *_rl_term_mh;
+static char *_rl_term_me;
+
 /* The key sequences output by the arrow keys, if this terminal has any. */
 static char *_rl_term_ku;
 static char *_rl_term_kd;
@@ -214,6 +226,10 @@ int _rl_enable_keypad;
 /* Non-zero means the user wants to enable a meta key. */
 int _rl_enable_meta = 1;
 
+/* Non-zero means to bracket each redisplay frame with the synchronized
+   output sequences, so terminals that support them draw it all at once. */
+int _rl_synchronized_output = 0;
+
 #if defined (__EMX__)
 static void
 _emx_get_screensize (int *swp, int *shp)
@@ -438,6 +454,8 @@ static const struct _tc_string tc_strings[] =
   { "ks", &_rl_term_ks },	/* start keypad mode */
   { "ku", &_rl_term_ku },
   { "le", &_rl_term_backspace },
+  { "me", &_rl_term_me },
+  { "mh", &_rl_term_mh },
   { "mm", &_rl_term_mm },
   { "mo", &_rl_term_mo },
   { "nd", &_rl_term_forward_char },
@@ -497,6 +515,7 @@ _rl_init_terminal_io (const char *terminal_name)
   _rl_term_kh = _rl_term_kH = _rl_term_at7 = _rl_term_kI = (char *)NULL;
   _rl_term_kN = _rl_term_kP = (char *)NULL;
   _rl_term_so = _rl_term_se = (char *)NULL;
+  _rl_term_mh = _rl_term_me = (char *)NULL;
 #if defined(HACK_TERMCAP_MOTION)
   _rl_term_forward_char = (char *)NULL;
 #endif
@@ -563,6 +582,7 @@ _rl_init_terminal_io (const char *terminal_name)
       _rl_term_ve = _rl_term_vs = (char *)NULL;
       _rl_term_forward_char = (char *)NULL;
       _rl_term_so = _rl_term_se = (char *)NULL;
+      _rl_term_mh = _rl_term_me = (char *)NULL;
       _rl_terminal_can_insert = term_has_meta = 0;
 
       /* Assume generic unknown terminal can't handle the enable/disable
@@ -628,7 +648,7 @@ _rl_init_terminal_io (const char *terminal_name)
   /* There's no way to determine whether or not a given terminal supports
      bracketed paste mode, so we assume a terminal named "dumb" does not. */
   if (dumbterm)
-    _rl_enable_bracketed_paste = _rl_enable_active_region = 0;
+    _rl_enable_bracketed_paste = _rl_enable_active_region = _rl_synchronized_output = 0;
 
   if (reset_region_colors)
     {
@@ -690,18 +710,135 @@ rl_reset_terminal (const char *terminal_name)
   return 0;
 }
 
+/* Redisplay frames.  Between _rl_frame_begin and _rl_frame_end the output
+   functions below append to a buffer instead of going through stdio, and
+   the frame goes out with as few write(2) calls as the terminal takes,
+   one unless it is interrupted or the descriptor is non-blocking.  Over
+   ssh and slow ptys a redisplay then costs one packet instead of many.
+   Frames nest, so a caller can group several redisplays into one.
+
+   With synchronized-output on, a frame is sent between the begin and end
+   synchronized update sequences (DEC private mode 2026), and a terminal
+   that knows them paints it in one go instead of showing the cursor run
+   across a long wrapped line.  Terminals that don't ignore them. */
+#define SYNC_BEGIN	"\033[?2026h"
+#define SYNC_END	"\033[?2026l"
+
+static struct
+{
+  char *buffer;
+  size_t length, size;
+  size_t start;
+  int depth;
+} _rl_frame;
+
+struct rl_redisplay_stats rl_redisplay_stats;
+
+static void
+_rl_frame_append (const char *string, size_t count)
+{
+  if (_rl_frame.length + count > _rl_frame.size)
+    {
+      _rl_frame.size = _rl_frame.size ? _rl_frame.size * 2 : 1024;
+      while (_rl_frame.length + count > _rl_frame.size)
+	_rl_frame.size *= 2;
+      _rl_frame.buffer = (char *)xrealloc (_rl_frame.buffer, _rl_frame.size);
+    }
+  memcpy (_rl_frame.buffer + _rl_frame.length, string, count);
+  _rl_frame.length += count;
+}
+
+void
+_rl_frame_begin (void)
+{
+  /* Whatever is still in the stdio buffer was written before the frame. */
+  if (_rl_frame.depth++ == 0)
+    {
+      fflush (_rl_out_stream);
+      _rl_frame.length = 0;
+      if (_rl_synchronized_output)
+	_rl_frame_append (SYNC_BEGIN, sizeof (SYNC_BEGIN) - 1);
+      _rl_frame.start = _rl_frame.length;
+    }
+}
+
+void
+_rl_frame_end (void)
+{
+  const char *string;
+  size_t left;
+  ssize_t n;
+  int fd;
+
+  if (_rl_frame.depth == 0 || --_rl_frame.depth)
+    return;
+
+  /* Don't send an empty synchronized update. */
+  if (_rl_frame.length == _rl_frame.start)
+    _rl_frame.length = 0;
+  else if (_rl_frame.start > 0)
+    _rl_frame_append (SYNC_END, sizeof (SYNC_END) - 1);
+
+  rl_redisplay_stats.frames++;
+  rl_redisplay_stats.frame_bytes = _rl_frame.length;
+  rl_redisplay_stats.frame_writes = 0;
+
+  fd = fileno (_rl_out_stream);
+  for (string = _rl_frame.buffer, left = _rl_frame.length; left > 0; )
+    {
+      n = write (fd, string, left);
+      rl_redisplay_stats.frame_writes++;
+      if (n < 0 && errno == EINTR)
+	continue;
+#if defined (HAVE_SELECT)
+      if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+	{
+	  fd_set writefds;
+
+	  /* Wait for the terminal to drain rather than drop the frame. */
+	  FD_ZERO (&writefds);
+	  FD_SET (fd, &writefds);
+	  if (select (fd + 1, (fd_set *)NULL, &writefds, (fd_set *)NULL, (struct timeval *)NULL) >= 0 || errno == EINTR)
+	    continue;
+	}
+#endif
+      if (n <= 0)
+	break;
+      string += n;
+      left -= n;
+    }
+  _rl_frame.length = 0;
+
+  rl_redisplay_stats.bytes += rl_redisplay_stats.frame_bytes;
+  rl_redisplay_stats.writes += rl_redisplay_stats.frame_writes;
+}
+
 /* A function for the use of tputs () */
 #ifdef _MINIX
 void
 _rl_output_character_function (int c)
 {
-  putc (c, _rl_out_stream);
+  char ch;
+
+  if (_rl_frame.depth)
+    {
+      ch = c;
+      _rl_frame_append (&ch, 1);
+    }
+  else
+    putc (c, _rl_out_stream);
 }
 #else /* !_MINIX */
 int
 _rl_output_character_function (int c)
 {
-  return putc (c, _rl_out_stream);
+  char ch;
+
+  if (_rl_frame.depth == 0)
+    return putc (c, _rl_out_stream);
+  ch = c;
+  _rl_frame_append (&ch, 1);
+  return ((unsigned char)c);
 }
 #endif /* !_MINIX */
 
@@ -709,7 +846,10 @@ _rl_output_character_function (int c)
 void
 _rl_output_some_chars (const char *string, int count)
 {
-  fwrite (string, 1, count, _rl_out_stream);
+  if (_rl_frame.depth)
+    _rl_frame_append (string, count);
+  else
+    fwrite (string, 1, count, _rl_out_stream);
 }
 
 /* Move the cursor back. */
@@ -725,7 +865,7 @@ _rl_backspace (int count)
   else
 #endif
     for (i = 0; i < count; i++)
-      putc ('\b', _rl_out_stream);
+      _rl_output_character_function ('\b');
   return 0;
 }
 
@@ -737,7 +877,7 @@ rl_crlf (void)
   if (_rl_term_cr)
     tputs (_rl_term_cr, 1, _rl_output_character_function);
 #endif /* NEW_TTY_DRIVER || __MINT__ */
-  putc ('\n', _rl_out_stream);
+  _rl_output_character_function ('\n');
   return 0;
 }
 
@@ -745,7 +885,7 @@ void
 _rl_cr (void)
 {
 #if defined (__MSDOS__)
-  putc ('\r', rl_outstream);
+  _rl_output_character_function ('\r');
 #else
   tputs (_rl_term_cr, 1, _rl_output_character_function);
 #endif
@@ -868,6 +1008,25 @@ _rl_region_color_off (void)
 #endif
 }
 
+/* Inline suggestions are drawn half-bright when the terminal can do it. */
+void
+_rl_suggestion_color_on (void)
+{
+#ifndef __MSDOS__
+  if (_rl_term_mh && _rl_term_me)
+    tputs (_rl_term_mh, 1, _rl_output_character_function);
+#endif
+}
+
+void
+_rl_suggestion_color_off (void)
+{
+#ifndef __MSDOS__
+  if (_rl_term_mh && _rl_term_me)
+    tputs (_rl_term_me, 1, _rl_output_character_function);
+#endif
+}
+
 /* **************************************************************** */
 /*								    */
 /*	 	Controlling the Meta Key and Keypad		    */
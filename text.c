@@ -92,6 +92,7 @@ rl_insert_text (const char *string)
   if (l == 0)
     return 0;
 
+  _rl_redisplay_damage (rl_point);
   if (rl_end + l >= rl_line_buffer_len)
     rl_extend_line_buffer (rl_end + l);
 
@@ -141,6 +142,7 @@ rl_delete_text (int from, int to)
   if (from < 0)
     from = 0;
 
+  _rl_redisplay_damage (from);
   text = rl_copy_text (from, to);
 
   /* Some versions of strncpy() can't handle overlapping arguments. */
@@ -217,6 +219,7 @@ rl_replace_line (const char *text, int clear_undo)
   len = strlen (text);
   if (len >= rl_line_buffer_len)
     rl_extend_line_buffer (len);
+  _rl_redisplay_damage (0);
   strcpy (rl_line_buffer, text);
   rl_end = len;
 
@@ -1476,6 +1479,7 @@ rl_change_case (int count, int op)
 
   /* We are going to modify some text, so let's prepare to undo it. */
   rl_modifying (start, end);
+  _rl_redisplay_damage (start);
 
   inword = 0;
   while (start < end)
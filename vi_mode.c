@@ -1161,6 +1161,7 @@ rl_domove_motion_callback (_rl_vimotion_cxt *m)
      work right at the end of the line.  Original value of rl_end is saved
      as m->end. */
   rl_extend_line_buffer (rl_end + 1);
+  _rl_redisplay_damage (rl_end);
   rl_line_buffer[rl_end++] = ' ';
   rl_line_buffer[rl_end] = '\0';
 
@@ -1190,6 +1191,7 @@ _rl_vi_domove_motion_cleanup (int c, _rl_vimotion_cxt *m)
   int r;
 
   /* Remove the blank that we added in rl_domove_motion_callback. */
+  _rl_redisplay_damage (m->end);
   rl_end = m->end;
   rl_line_buffer[rl_end] = '\0';
   _rl_fix_point (0);